@@ -0,0 +1,43 @@
+#ifndef SPH_BENCH_SCENE_H
+#define SPH_BENCH_SCENE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include "sphParticles.h"
+#include "sphSettings.h"
+
+/// Fills particles with a block on a jittered lattice of the given
+/// separation, shaped as a column narrow enough to stay inside the
+/// simulation box at any particle count.
+inline void initColumnParticles(
+    ParticleData &particles, const SPHSettings &settings, float separation)
+{
+    const size_t width = std::min<size_t>(
+        size_t(std::cbrt(double(particles.count))) + 1,
+        size_t(7.0f / separation));
+    std::srand(1024);
+    for (size_t i = 0; i < particles.count; i++) {
+        size_t x = i % width;
+        size_t z = (i / width) % width;
+        size_t y = i / (width * width);
+        particles.posX[i] = x * separation - 3.5f
+            + (float(rand()) / float(RAND_MAX) * 0.5f - 1) * settings.h / 10;
+        particles.posY[i] = y * separation + settings.h + 0.1f
+            + (float(rand()) / float(RAND_MAX) * 0.5f - 1) * settings.h / 10;
+        particles.posZ[i] = z * separation - 3.5f
+            + (float(rand()) / float(RAND_MAX) * 0.5f - 1) * settings.h / 10;
+        particles.velX[i] = 0.0f;
+        particles.velY[i] = 0.0f;
+        particles.velZ[i] = 0.0f;
+    }
+}
+
+/// Column on the lattice of SphSystem::initParticles, a little wider than
+/// h, so it has next to no neighbours until it landed.
+inline void initColumnParticles(ParticleData &particles, const SPHSettings &settings)
+{
+    initColumnParticles(particles, settings, settings.h + 0.01f);
+}
+
+#endif // SPH_BENCH_SCENE_H
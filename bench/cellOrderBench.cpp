@@ -0,0 +1,218 @@
+/// Compares the linear and the Morton cell order: time per step and cache
+/// misses of the whole CPU update at 100k and 1M particles.
+///
+/// usage: sph_cell_order_bench [--particles N]... [--steps S] [--threads T]
+///
+/// Cache misses come from Linux perf counters (L1 data cache and last
+/// level cache reads) and are reported as n/a where those are unavailable.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "sphCalculation.h"
+#include "benchScene.h"
+
+namespace {
+
+/// Hardware counter that also counts the threads created after it was
+/// opened, i.e. the workers of a thread pool constructed afterwards.
+class CacheCounter
+{
+public:
+    CacheCounter(uint64_t cacheId)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = cacheId | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~CacheCounter()
+    {
+#ifdef __linux__
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+    }
+
+    CacheCounter(const CacheCounter &) = delete;
+    CacheCounter &operator=(const CacheCounter &) = delete;
+
+    bool isOpen() const { return fd >= 0; }
+
+    void start()
+    {
+#ifdef __linux__
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    void stop()
+    {
+#ifdef __linux__
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+#endif
+    }
+
+    uint64_t read() const
+    {
+        uint64_t value = 0;
+#ifdef __linux__
+        if (fd >= 0 && ::read(fd, &value, sizeof(value)) != sizeof(value)) {
+            value = 0;
+        }
+#endif
+        return value;
+    }
+
+private:
+    int fd{-1};
+};
+
+#ifndef __linux__
+const uint64_t PERF_COUNT_HW_CACHE_L1D = 0;
+const uint64_t PERF_COUNT_HW_CACHE_LL = 2;
+#endif
+
+struct RunResult
+{
+    double msPerStep{0};
+    uint64_t l1Misses{0};
+    uint64_t llcMisses{0};
+    bool countersOpen{false};
+};
+
+RunResult runSteps(
+    size_t particleCount, CellOrder order, int warmupSteps, int steps,
+    size_t threadCount)
+{
+    SPHSettings settings(0.02f, 1000, 1, 1.04f, 0.15f, -9.8f, 0.2f);
+    settings.cellOrder = order;
+    ParticleData particles(particleCount);
+    ParticleData sortBuffer(particleCount);
+    initColumnParticles(particles, settings);
+
+    // Counters first, so the pool's workers inherit them
+    CacheCounter l1Counter(PERF_COUNT_HW_CACHE_L1D);
+    CacheCounter llcCounter(PERF_COUNT_HW_CACHE_LL);
+    ThreadPool threadPool(threadCount);
+    RadixSorter sorter;
+    NeighborGrid grid;
+    NeighborList neighborList;
+    ParticleTasks tasks;
+    NeighborStats stats;
+    MotionBounds motion;
+    ContinuityState continuity;
+    const float deltaTime = 0.003f;
+
+    for (int i = 0; i < warmupSteps; i++) {
+        updateParticles(
+            threadPool, sorter, grid, neighborList, tasks, particles,
+            sortBuffer, settings, deltaTime, false, stats, motion, continuity);
+    }
+
+    l1Counter.start();
+    llcCounter.start();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < steps; i++) {
+        updateParticles(
+            threadPool, sorter, grid, neighborList, tasks, particles,
+            sortBuffer, settings, deltaTime, false, stats, motion, continuity);
+    }
+    auto end = std::chrono::steady_clock::now();
+    l1Counter.stop();
+    llcCounter.stop();
+
+    RunResult result;
+    result.msPerStep
+        = std::chrono::duration<double, std::milli>(end - start).count() / steps;
+    result.countersOpen = l1Counter.isOpen() && llcCounter.isOpen();
+    result.l1Misses = l1Counter.read() / steps;
+    result.llcMisses = llcCounter.read() / steps;
+    return result;
+}
+
+void printMisses(const RunResult &result, uint64_t misses, size_t particleCount)
+{
+    if (result.countersOpen) {
+        std::printf(" %14llu %8.2f", (unsigned long long)misses,
+            double(misses) / double(particleCount));
+    }
+    else {
+        std::printf(" %14s %8s", "n/a", "n/a");
+    }
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<size_t> particleCounts;
+    int steps = 10;
+    size_t threadCount = std::thread::hardware_concurrency();
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        if (option == "--particles") {
+            particleCounts.push_back(std::strtoull(argv[i + 1], nullptr, 10));
+        }
+        else if (option == "--steps") {
+            steps = std::max(1, std::atoi(argv[i + 1]));
+        }
+        else if (option == "--threads") {
+            threadCount = std::max<size_t>(1, std::strtoull(argv[i + 1], nullptr, 10));
+        }
+        else {
+            std::fprintf(stderr, "unknown option %s\n", option.c_str());
+            return 1;
+        }
+    }
+    if (particleCounts.empty()) {
+        particleCounts = {100000, 1000000};
+    }
+
+    std::printf("%10s %8s %10s %14s %8s %14s %8s\n", "particles", "order",
+        "ms/step", "L1D miss/step", "/part", "LLC miss/step", "/part");
+    for (size_t particleCount : particleCounts) {
+        for (CellOrder order : {CellOrder::Linear, CellOrder::Morton}) {
+            RunResult result = runSteps(particleCount, order, 3, steps, threadCount);
+            std::printf("%10zu %8s %10.2f", particleCount,
+                order == CellOrder::Linear ? "linear" : "morton",
+                result.msPerStep);
+            printMisses(result, result.l1Misses, particleCount);
+            printMisses(result, result.llcMisses, particleCount);
+            std::printf("\n");
+            std::fflush(stdout);
+        }
+    }
+    return 0;
+}
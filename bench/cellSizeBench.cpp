@@ -0,0 +1,163 @@
+/// Compares grid cells of h, h/2 and h/3: distance tests per neighbour
+/// found and the time of the density pass, the force pass and the whole
+/// CPU step at 100k and 1M particles.
+///
+/// usage: sph_cell_size_bench [--particles N]... [--cells-per-radius C]...
+///                            [--spacing S] [--steps S] [--threads T]
+///                            [--simd scalar|sse|avx2|avx512]
+///
+/// The particles start on a lattice --spacing times h apart, 0.5 by
+/// default for about 30 neighbours per particle as in a settled fluid.
+/// Smaller cells need a larger stencil of smaller cells, which fits the
+/// support sphere more tightly: fewer candidates fail the distance test,
+/// for more and shorter particle runs per cell.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sphCalculation.h"
+#include "benchScene.h"
+
+namespace {
+
+struct RunResult
+{
+    size_t stencilCells{0};
+    double candidatesPerParticle{0};
+    double neighborsPerParticle{0};
+    double densityMs{0};
+    double forcesMs{0};
+    double msPerStep{0};
+};
+
+template <class Function>
+double timeMs(int repeats, const Function &function)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; i++) {
+        function();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / repeats;
+}
+
+RunResult runSteps(
+    size_t particleCount, int cellsPerRadius, SimdLevel simdLevel,
+    float spacing, int warmupSteps, int steps, size_t threadCount)
+{
+    SPHSettings settings(0.02f, 1000, 1, 1.04f, 0.15f, -9.8f, 0.2f);
+    settings.cellsPerRadius = cellsPerRadius;
+    settings.simdLevel = simdLevel;
+    ParticleData particles(particleCount);
+    ParticleData sortBuffer(particleCount);
+    initColumnParticles(particles, settings, spacing * settings.h);
+
+    ThreadPool threadPool(threadCount);
+    RadixSorter sorter;
+    NeighborGrid grid;
+    NeighborList neighborList;
+    ParticleTasks tasks;
+    NeighborStats stats;
+    MotionBounds motion;
+    ContinuityState continuity;
+    const float deltaTime = 0.003f;
+    auto step = [&]() {
+        updateParticles(
+            threadPool, sorter, grid, neighborList, tasks, particles,
+            sortBuffer, settings, deltaTime, false, stats, motion, continuity);
+    };
+
+    for (int i = 0; i < warmupSteps; i++) {
+        step();
+    }
+    RunResult result;
+    result.msPerStep = timeMs(steps, step);
+    result.stencilCells = grid.getStencil().offsets.size();
+    result.candidatesPerParticle = double(stats.candidatePairs) / double(particleCount);
+    result.neighborsPerParticle = double(stats.neighborPairs) / double(particleCount);
+
+    // The passes on their own, on the grid of the last step
+    result.densityMs = timeMs(steps, [&]() {
+        computeDensities(
+            threadPool, tasks, particles, grid, neighborList, settings, stats);
+    });
+    result.forcesMs = timeMs(steps, [&]() {
+        computeForces(threadPool, tasks, particles, grid, neighborList, settings);
+    });
+    return result;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<size_t> particleCounts;
+    std::vector<int> cellCounts;
+    float spacing = 0.5f;
+    int steps = 10;
+    size_t threadCount = std::thread::hardware_concurrency();
+    SimdLevel simdLevel = detectSimdLevel();
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        if (option == "--particles") {
+            particleCounts.push_back(std::strtoull(argv[i + 1], nullptr, 10));
+        }
+        else if (option == "--cells-per-radius") {
+            cellCounts.push_back(std::max(1, std::atoi(argv[i + 1])));
+        }
+        else if (option == "--spacing") {
+            spacing = std::max(0.05f, float(std::atof(argv[i + 1])));
+        }
+        else if (option == "--steps") {
+            steps = std::max(1, std::atoi(argv[i + 1]));
+        }
+        else if (option == "--threads") {
+            threadCount = std::max<size_t>(1, std::strtoull(argv[i + 1], nullptr, 10));
+        }
+        else if (option == "--simd") {
+            SimdLevel level;
+            if (!parseSimdLevel(argv[i + 1], level) || level > detectSimdLevel()) {
+                std::fprintf(stderr, "unsupported simd level %s\n", argv[i + 1]);
+                return 1;
+            }
+            simdLevel = level;
+        }
+        else {
+            std::fprintf(stderr, "unknown option %s\n", option.c_str());
+            return 1;
+        }
+    }
+    if (particleCounts.empty()) {
+        particleCounts = {100000, 1000000};
+    }
+    if (cellCounts.empty()) {
+        cellCounts = {1, 2, 3};
+    }
+
+    std::printf("%zu threads, %s kernels, lattice spacing %.2f h\n",
+        threadCount, getSimdLevelName(simdLevel), spacing);
+    std::printf("%10s %6s %8s %12s %12s %10s %11s %10s %10s\n", "particles",
+        "cell", "stencil", "cand/part", "neigh/part", "cand/neigh",
+        "density ms", "forces ms", "ms/step");
+    for (size_t particleCount : particleCounts) {
+        for (int cellsPerRadius : cellCounts) {
+            RunResult result = runSteps(
+                particleCount, cellsPerRadius, simdLevel, spacing, 3, steps,
+                threadCount);
+            std::string cell = cellsPerRadius == 1
+                ? "h" : "h/" + std::to_string(cellsPerRadius);
+            std::printf("%10zu %6s %8zu %12.1f %12.1f %10.2f %11.2f %10.2f %10.2f\n",
+                particleCount, cell.c_str(), result.stencilCells,
+                result.candidatesPerParticle, result.neighborsPerParticle,
+                result.candidatesPerParticle / std::max(result.neighborsPerParticle, 1e-9),
+                result.densityMs, result.forcesMs, result.msPerStep);
+            std::fflush(stdout);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,423 @@
+/// Microbenchmarks of every phase of a CPU step: cell keys, sort, grid
+/// build, densities, forces and integration, each timed on its own over
+/// a range of particle and thread counts. forces-half times the force
+/// pass with the half stencil next to the full one, forces-continuity the
+/// force pass that also sums the continuity density rate. resort re-sorts
+/// the keys the particles have after one more step incrementally.
+///
+/// usage: sph_bench [--particles N]... [--threads T]... [--phase name]...
+///                  [--min-time seconds] [--simd scalar|sse|avx2|avx512]
+///                  [--json path]
+///
+/// Reports the time per iteration, ns per particle and the bandwidth of
+/// every particle's own data (neighbour reads served from cache are not
+/// counted). --json writes the results in the Google Benchmark JSON
+/// layout, so its tools can compare runs across commits.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sphCalculation.h"
+#include "benchScene.h"
+
+namespace {
+
+const char *PHASE_NAMES[] = {
+    "keys", "sort", "resort", "grid", "density", "forces", "forces-half",
+    "forces-continuity", "integration",
+};
+
+struct BenchOptions
+{
+    std::vector<size_t> particleCounts;
+    std::vector<size_t> threadCounts;
+    std::vector<std::string> phases;
+    double minTime{0.5};
+    SimdLevel simdLevel{detectSimdLevel()};
+    std::string jsonPath;
+};
+
+struct BenchResult
+{
+    std::string name;
+    std::string phase;
+    size_t particles;
+    size_t threads;
+    uint64_t iterations;
+    double realNs;
+    double cpuNs;
+    double bytesPerParticle;
+};
+
+/// Particles one step into the simulation, sorted and indexed, so every
+/// phase can run on its own repeatedly.
+struct BenchScene
+{
+    BenchScene(size_t particleCount, size_t threadCount, SimdLevel simdLevel):
+        settings(0.02f, 1000, 1, 1.04f, 0.15f, -9.8f, 0.2f),
+        particles(particleCount),
+        sortBuffer(particleCount),
+        threadPool(threadCount)
+    {
+        settings.simdLevel = simdLevel;
+        initColumnParticles(particles, settings);
+        for (int i = 0; i < 2; i++) {
+            updateParticles(
+                threadPool, sorter, grid, neighborList, tasks, particles,
+                sortBuffer, settings, 0.003f, false, stats, motion, continuity);
+        }
+        computeCellKeys(threadPool, particles, grid.getDomain());
+        sortParticles(threadPool, sorter, particles, sortBuffer, getMaxKey());
+        grid.build(threadPool, particles.cellKey, particles.count);
+        tasks.build(threadPool, particles, settings.workStealing);
+
+        // The keys after one more step of the same length, whose movers
+        // the resort phase places
+        const CellDomain &domain = grid.getDomain();
+        movedKeys.resize(particleCount);
+        for (size_t i = 0; i < particleCount; i++) {
+            glm::vec3 position(
+                particles.posX[i] + 0.003f * particles.velX[i],
+                particles.posY[i] + 0.003f * particles.velY[i],
+                particles.posZ[i] + 0.003f * particles.velZ[i]);
+            movedKeys[i] = domain.getKey(domain.getCell(position));
+        }
+    }
+
+    uint32_t getMaxKey() const { return grid.getDomain().getKeyCount() - 1; }
+
+    SPHSettings settings;
+    ParticleData particles;
+    ParticleData sortBuffer;
+    ThreadPool threadPool;
+    RadixSorter sorter;
+    NeighborGrid grid;
+    NeighborList neighborList;
+    ParticleTasks tasks;
+    NeighborStats stats;
+    MotionBounds motion;
+    ContinuityState continuity;
+    std::vector<uint32_t> movedKeys;
+};
+
+/// Bytes of every particle's own data a phase reads and writes.
+double getBytesPerParticle(const std::string &phase, const BenchScene &scene)
+{
+    const double count = double(scene.particles.count);
+    if (phase == "keys") {
+        // position in, key out
+        return 12 + 4;
+    }
+    if (phase == "sort") {
+        // per radix pass the keys twice, the order once, keys and order
+        // out; then the gather of position, velocity, key and neighbour
+        // count
+        uint32_t maxKey = scene.getMaxKey();
+        int keyBits = 1;
+        while (keyBits < 32 && (maxKey >> keyBits) != 0) {
+            keyBits++;
+        }
+        int passes = (keyBits + 10) / 11;
+        return passes * 20 + 4 + 2 * 32;
+    }
+    if (phase == "resort") {
+        // keys and the run starts of the grid, then the movers' keys and
+        // the merge, and the same gather as sort
+        return 4 + 8 + 2 * 32;
+    }
+    if (phase == "grid") {
+        // keys twice, then start, end and list entry of every cell
+        return 8 + 20 * double(scene.grid.getOccupiedCount()) / count;
+    }
+    if (phase == "density") {
+        // position in, density, pressure and neighbour count out
+        return 12 + 12;
+    }
+    if (phase == "forces" || phase == "forces-half") {
+        // position, velocity, pressure, density in, force out
+        return 32 + 12;
+    }
+    if (phase == "forces-continuity") {
+        // the same and the density rate out
+        return 32 + 16;
+    }
+    // position, velocity, force, density in, position, velocity and the
+    // next cell key out
+    return 40 + 24 + 4;
+}
+
+std::function<void()> getPhase(const std::string &phase, BenchScene &scene)
+{
+    if (phase == "keys") {
+        return [&scene]() {
+            computeCellKeys(scene.threadPool, scene.particles, scene.grid.getDomain());
+        };
+    }
+    if (phase == "sort") {
+        // The keys are already sorted, as they nearly are from step to step
+        return [&scene]() {
+            sortParticles(
+                scene.threadPool, scene.sorter, scene.particles,
+                scene.sortBuffer, scene.getMaxKey());
+        };
+    }
+    if (phase == "resort") {
+        // The gather is undone, so every call places the same movers
+        return [&scene]() {
+            const uint32_t *order = scene.sorter.resort(
+                scene.threadPool, scene.movedKeys.data(), scene.particles.count,
+                scene.getMaxKey(), scene.grid, scene.particles.count);
+            gatherParticles(
+                scene.threadPool, scene.particles, scene.sortBuffer, order);
+            scene.particles.swap(scene.sortBuffer);
+        };
+    }
+    if (phase == "grid") {
+        return [&scene]() {
+            scene.grid.build(
+                scene.threadPool, scene.particles.cellKey, scene.particles.count);
+        };
+    }
+    if (phase == "density") {
+        return [&scene]() {
+            computeDensities(
+                scene.threadPool, scene.tasks, scene.particles, scene.grid,
+                scene.neighborList, scene.settings, scene.stats);
+        };
+    }
+    if (phase == "forces") {
+        return [&scene]() {
+            computeForces(
+                scene.threadPool, scene.tasks, scene.particles, scene.grid,
+                scene.neighborList, scene.settings);
+        };
+    }
+    if (phase == "forces-half") {
+        return [&scene]() {
+            SPHSettings settings = scene.settings;
+            settings.halfStencil = true;
+            computeForces(
+                scene.threadPool, scene.tasks, scene.particles, scene.grid,
+                scene.neighborList, settings);
+        };
+    }
+    if (phase == "forces-continuity") {
+        return [&scene]() {
+            SPHSettings settings = scene.settings;
+            settings.continuityDensity = true;
+            computeForces(
+                scene.threadPool, scene.tasks, scene.particles, scene.grid,
+                scene.neighborList, settings);
+        };
+    }
+    // A zero time step repeats the same work without moving the particles
+    // out of the cells the grid was built for
+    return [&scene]() {
+        glm::vec3 lower, upper;
+        integrateParticles(
+            scene.threadPool, scene.tasks, scene.particles, scene.settings,
+            0.0f, scene.grid.getDomain(), lower, upper, scene.motion);
+    };
+}
+
+/// Runs the phase until minTime passed, after one warm-up call.
+BenchResult runPhase(
+    const std::string &phase, BenchScene &scene, double minTime)
+{
+    std::function<void()> run = getPhase(phase, scene);
+    run();
+
+    uint64_t iterations = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::clock_t cpuStart = std::clock();
+    double elapsed = 0.0;
+    while (elapsed < minTime || iterations == 0) {
+        run();
+        iterations++;
+        elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+    double cpuElapsed = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+    BenchResult result;
+    result.phase = phase;
+    result.particles = scene.particles.count;
+    result.threads = scene.threadPool.size();
+    result.name = phase + "/" + std::to_string(result.particles)
+        + "/threads:" + std::to_string(result.threads);
+    result.iterations = iterations;
+    result.realNs = elapsed * 1e9 / double(iterations);
+    result.cpuNs = cpuElapsed * 1e9 / double(iterations);
+    result.bytesPerParticle = getBytesPerParticle(phase, scene);
+    return result;
+}
+
+std::string escapeJson(const std::string &text)
+{
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+bool writeJson(const std::string &path, const std::vector<BenchResult> &results,
+    const BenchOptions &options, const char *executable)
+{
+    FILE *file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        std::fprintf(stderr, "failed to write '%s'\n", path.c_str());
+        return false;
+    }
+
+    char date[64];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+#ifdef NDEBUG
+    const char *buildType = "release";
+#else
+    const char *buildType = "debug";
+#endif
+
+    std::fprintf(file, "{\n  \"context\": {\n");
+    std::fprintf(file, "    \"date\": \"%s\",\n", date);
+    std::fprintf(file, "    \"executable\": \"%s\",\n", escapeJson(executable).c_str());
+    std::fprintf(file, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+    std::fprintf(file, "    \"library_build_type\": \"%s\",\n", buildType);
+    std::fprintf(file, "    \"simd\": \"%s\"\n", getSimdLevelName(options.simdLevel));
+    std::fprintf(file, "  },\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &result = results[i];
+        double seconds = result.realNs * 1e-9;
+        std::fprintf(file, "    {\n");
+        std::fprintf(file, "      \"name\": \"%s\",\n", result.name.c_str());
+        std::fprintf(file, "      \"run_name\": \"%s\",\n", result.name.c_str());
+        std::fprintf(file, "      \"run_type\": \"iteration\",\n");
+        std::fprintf(file, "      \"repetitions\": 1,\n");
+        std::fprintf(file, "      \"repetition_index\": 0,\n");
+        std::fprintf(file, "      \"threads\": 1,\n");
+        std::fprintf(file, "      \"iterations\": %llu,\n", (unsigned long long)result.iterations);
+        std::fprintf(file, "      \"real_time\": %.3f,\n", result.realNs);
+        std::fprintf(file, "      \"cpu_time\": %.3f,\n", result.cpuNs);
+        std::fprintf(file, "      \"time_unit\": \"ns\",\n");
+        std::fprintf(file, "      \"bytes_per_second\": %.6e,\n",
+            result.bytesPerParticle * double(result.particles) / seconds);
+        std::fprintf(file, "      \"items_per_second\": %.6e,\n", double(result.particles) / seconds);
+        std::fprintf(file, "      \"ns_per_particle\": %.6f,\n", result.realNs / double(result.particles));
+        std::fprintf(file, "      \"particles\": %zu,\n", result.particles);
+        std::fprintf(file, "      \"pool_threads\": %zu\n", result.threads);
+        std::fprintf(file, "    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(file, "  ]\n}\n");
+    std::fclose(file);
+    return true;
+}
+
+bool parseOptions(int argc, char **argv, BenchOptions &options)
+{
+    for (int i = 1; i < argc; i += 2) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "missing value for %s\n", option.c_str());
+            return false;
+        }
+        std::string value = argv[i + 1];
+        if (option == "--particles") {
+            options.particleCounts.push_back(std::strtoull(value.c_str(), nullptr, 10));
+        }
+        else if (option == "--threads") {
+            options.threadCounts.push_back(std::max<size_t>(1, std::strtoull(value.c_str(), nullptr, 10)));
+        }
+        else if (option == "--phase") {
+            bool known = false;
+            for (const char *phase : PHASE_NAMES) {
+                known = known || value == phase;
+            }
+            if (!known) {
+                std::fprintf(stderr, "unknown phase %s\n", value.c_str());
+                return false;
+            }
+            options.phases.push_back(value);
+        }
+        else if (option == "--min-time") {
+            options.minTime = std::atof(value.c_str());
+        }
+        else if (option == "--simd") {
+            SimdLevel level;
+            if (!parseSimdLevel(value.c_str(), level) || level > detectSimdLevel()) {
+                std::fprintf(stderr, "unsupported simd level %s\n", value.c_str());
+                return false;
+            }
+            options.simdLevel = level;
+        }
+        else if (option == "--json") {
+            options.jsonPath = value;
+        }
+        else {
+            std::fprintf(stderr, "unknown option %s\n", option.c_str());
+            return false;
+        }
+    }
+
+    if (options.particleCounts.empty()) {
+        options.particleCounts = {10000, 100000, 1000000, 4000000};
+    }
+    if (options.threadCounts.empty()) {
+        options.threadCounts.push_back(1);
+        size_t hardwareThreads = std::thread::hardware_concurrency();
+        if (hardwareThreads > 1) {
+            options.threadCounts.push_back(hardwareThreads);
+        }
+    }
+    if (options.phases.empty()) {
+        options.phases.assign(std::begin(PHASE_NAMES), std::end(PHASE_NAMES));
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
+    }
+
+    std::vector<BenchResult> results;
+    std::printf("%-32s %10s %12s %12s %10s\n",
+        "benchmark", "iterations", "ms/iter", "ns/particle", "GB/s");
+    for (size_t particleCount : options.particleCounts) {
+        for (size_t threadCount : options.threadCounts) {
+            BenchScene scene(particleCount, threadCount, options.simdLevel);
+            for (const std::string &phase : options.phases) {
+                BenchResult result = runPhase(phase, scene, options.minTime);
+                double bytes = result.bytesPerParticle * double(result.particles);
+                std::printf("%-32s %10llu %12.3f %12.3f %10.2f\n",
+                    result.name.c_str(), (unsigned long long)result.iterations,
+                    result.realNs * 1e-6, result.realNs / double(result.particles),
+                    bytes / result.realNs);
+                std::fflush(stdout);
+                results.push_back(result);
+            }
+        }
+    }
+
+    if (!options.jsonPath.empty()
+        && !writeJson(options.jsonPath, results, options, argv[0])) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+/// Times the marching cubes surface extraction of a settled particle
+/// column at 256^3 and 512^3 voxels along the longest side.
+///
+/// usage: sph_surface_bench [--particles N] [--resolution R]... [--frames F]
+///                          [--threads T]
+///
+/// The first frame of every resolution grows the extractor's buffers and
+/// is not timed, as in an animation where they persist across frames.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sphCalculation.h"
+#include "surfaceExtractor.h"
+#include "benchScene.h"
+
+int main(int argc, char **argv)
+{
+    size_t particleCount = 100000;
+    std::vector<int> resolutions;
+    int frames = 10;
+    size_t threadCount = std::thread::hardware_concurrency();
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        if (option == "--particles") {
+            particleCount = std::max<size_t>(1, std::strtoull(argv[i + 1], nullptr, 10));
+        }
+        else if (option == "--resolution") {
+            resolutions.push_back(std::max(1, std::atoi(argv[i + 1])));
+        }
+        else if (option == "--frames") {
+            frames = std::max(1, std::atoi(argv[i + 1]));
+        }
+        else if (option == "--threads") {
+            threadCount = std::max<size_t>(1, std::strtoull(argv[i + 1], nullptr, 10));
+        }
+        else {
+            std::fprintf(stderr, "unknown option %s\n", option.c_str());
+            return 1;
+        }
+    }
+    if (resolutions.empty()) {
+        resolutions = {256, 512};
+    }
+
+    SPHSettings settings(0.02f, 1000, 1, 1.04f, 0.15f, -9.8f, 0.2f);
+    ParticleData particles(particleCount);
+    ParticleData sortBuffer(particleCount);
+    initColumnParticles(particles, settings);
+
+    ThreadPool threadPool(threadCount);
+    RadixSorter sorter;
+    NeighborGrid grid;
+    NeighborList neighborList;
+    ParticleTasks tasks;
+    NeighborStats stats;
+    MotionBounds motion;
+    ContinuityState continuity;
+    // Let the column start to collapse, so the surface is not a lattice
+    for (int i = 0; i < 20; i++) {
+        updateParticles(
+            threadPool, sorter, grid, neighborList, tasks, particles,
+            sortBuffer, settings, 0.003f, false, stats, motion, continuity);
+    }
+
+    std::printf("%zu particles, %zu threads\n", particleCount, threadPool.size());
+    std::printf("%10s %16s %10s %12s %14s\n",
+        "resolution", "voxels", "ms/frame", "triangles", "active blocks");
+    SurfaceExtractor extractor;
+    SurfaceMesh mesh;
+    for (int resolution : resolutions) {
+        SurfaceSettings surface;
+        surface.resolution = resolution;
+        extractor.extract(threadPool, particles, grid, settings, surface, mesh);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++) {
+            extractor.extract(threadPool, particles, grid, settings, surface, mesh);
+        }
+        auto end = std::chrono::steady_clock::now();
+        double msPerFrame
+            = std::chrono::duration<double, std::milli>(end - start).count() / frames;
+
+        const glm::ivec3 &dims = extractor.getVoxelDims();
+        char voxels[48];
+        std::snprintf(voxels, sizeof(voxels), "%dx%dx%d", dims.x, dims.y, dims.z);
+        std::printf("%10d %16s %10.2f %12zu %14zu\n", resolution, voxels, msPerFrame,
+            mesh.indices.size() / 3, extractor.getActiveBlockCount());
+        std::fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,343 @@
+/// Runs the simulation without a window: reads a config, advances a fixed
+/// number of steps at full speed and writes particle snapshots.
+///
+/// usage: sph_headless [config file] [--key value]...
+///
+/// The config holds one "key = value" per line, '#' starts a comment and
+/// command line options override the file. See example.cfg for the keys.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "profiler.h"
+#include "sphSimulation.h"
+
+namespace {
+
+const char *KNOWN_KEYS[] = {
+    "cubeWidth", "mass", "restDensity", "gasConstant", "viscosity", "h", "g",
+    "tension", "steps", "deltaTime", "threads", "neighborList", "neighborSkin",
+    "cellOrder", "cellsPerRadius", "simd", "halfStencil", "workStealing",
+    "pinThreads", "incrementalSort", "fullSortInterval", "continuityDensity",
+    "densityReinitInterval", "adaptiveTimeStep", "cflFactor", "forceFactor",
+    "viscousFactor", "minTimeStep", "maxTimeStep", "output", "outputEvery", "surfaceResolution",
+    "trace",
+};
+
+using Config = std::map<std::string, std::string>;
+
+std::string trim(const std::string &text)
+{
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+        return "";
+    }
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+bool isKnownKey(const std::string &key)
+{
+    for (const char *known : KNOWN_KEYS) {
+        if (key == known) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool setValue(Config &config, const std::string &key, const std::string &value)
+{
+    if (!isKnownKey(key)) {
+        std::fprintf(stderr, "unknown config key '%s'\n", key.c_str());
+        return false;
+    }
+    config[key] = value;
+    return true;
+}
+
+bool readConfigFile(const std::string &path, Config &config)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::fprintf(stderr, "failed to open config '%s'\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+        size_t separator = line.find('=');
+        if (separator == std::string::npos) {
+            std::fprintf(stderr, "%s:%d: expected key = value\n", path.c_str(), lineNumber);
+            return false;
+        }
+        if (!setValue(config, trim(line.substr(0, separator)), trim(line.substr(separator + 1)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+float getFloat(const Config &config, const char *key, float fallback)
+{
+    auto it = config.find(key);
+    return it == config.end() ? fallback : std::strtof(it->second.c_str(), nullptr);
+}
+
+long getInt(const Config &config, const char *key, long fallback)
+{
+    auto it = config.find(key);
+    return it == config.end() ? fallback : std::strtol(it->second.c_str(), nullptr, 10);
+}
+
+std::string getString(const Config &config, const char *key, const std::string &fallback)
+{
+    auto it = config.find(key);
+    return it == config.end() ? fallback : it->second;
+}
+
+bool parseCellOrder(const std::string &name, CellOrder &order)
+{
+    if (name == "linear") {
+        order = CellOrder::Linear;
+    }
+    else if (name == "morton") {
+        order = CellOrder::Morton;
+    }
+    else {
+        std::fprintf(stderr, "unknown cell order '%s', use linear or morton\n", name.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool parseSimd(const std::string &name, SimdLevel &level)
+{
+    if (name == "auto") {
+        level = detectSimdLevel();
+        return true;
+    }
+    if (!parseSimdLevel(name.c_str(), level)) {
+        std::fprintf(stderr, "unknown simd level '%s'\n", name.c_str());
+        return false;
+    }
+    if (level > detectSimdLevel()) {
+        std::fprintf(stderr, "%s is not supported by this CPU\n", getSimdLevelName(level));
+        return false;
+    }
+    return true;
+}
+
+/// One CSV file per snapshot, a row per particle.
+bool writeSnapshot(const std::string &prefix, long step, const ParticleData &particles)
+{
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), "_%06ld.csv", step);
+    std::string path = prefix + suffix;
+    FILE *file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        std::fprintf(stderr, "failed to write '%s'\n", path.c_str());
+        return false;
+    }
+    std::fprintf(file, "x,y,z,vx,vy,vz,density\n");
+    for (size_t i = 0; i < particles.count; i++) {
+        std::fprintf(file, "%g,%g,%g,%g,%g,%g,%g\n",
+            particles.posX[i], particles.posY[i], particles.posZ[i],
+            particles.velX[i], particles.velY[i], particles.velZ[i],
+            particles.density[i]);
+    }
+    std::fclose(file);
+    return true;
+}
+
+/// Wavefront OBJ of the marching cubes surface, next to the CSV snapshot.
+bool writeSurface(const std::string &prefix, long step, const SurfaceMesh &mesh)
+{
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), "_%06ld.obj", step);
+    std::string path = prefix + suffix;
+    FILE *file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        std::fprintf(stderr, "failed to write '%s'\n", path.c_str());
+        return false;
+    }
+    for (const glm::vec3 &position : mesh.positions) {
+        std::fprintf(file, "v %g %g %g\n", position.x, position.y, position.z);
+    }
+    for (const glm::vec3 &normal : mesh.normals) {
+        std::fprintf(file, "vn %g %g %g\n", normal.x, normal.y, normal.z);
+    }
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        uint32_t a = mesh.indices[i] + 1;
+        uint32_t b = mesh.indices[i + 1] + 1;
+        uint32_t c = mesh.indices[i + 2] + 1;
+        std::fprintf(file, "f %u//%u %u//%u %u//%u\n", a, a, b, b, c, c);
+    }
+    std::fclose(file);
+    return true;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    Config config;
+    int argIndex = 1;
+    if (argIndex < argc && std::string(argv[argIndex]).rfind("--", 0) != 0) {
+        if (!readConfigFile(argv[argIndex], config)) {
+            return 1;
+        }
+        argIndex++;
+    }
+    for (; argIndex < argc; argIndex += 2) {
+        std::string option = argv[argIndex];
+        if (option.rfind("--", 0) != 0 || argIndex + 1 >= argc) {
+            std::fprintf(stderr, "usage: %s [config file] [--key value]...\n", argv[0]);
+            return 1;
+        }
+        if (!setValue(config, option.substr(2), argv[argIndex + 1])) {
+            return 1;
+        }
+    }
+
+    // Defaults match the interactive application
+    SPHSettings settings(
+        getFloat(config, "mass", 0.02f), getFloat(config, "restDensity", 1000),
+        getFloat(config, "gasConstant", 1), getFloat(config, "viscosity", 1.04f),
+        getFloat(config, "h", 0.15f), getFloat(config, "g", -9.8f),
+        getFloat(config, "tension", 0.2f));
+    settings.useNeighborList = getInt(config, "neighborList", 0) != 0;
+    settings.neighborSkin = getFloat(config, "neighborSkin", settings.neighborSkin);
+    settings.cellsPerRadius = int(getInt(config, "cellsPerRadius", 1));
+    settings.halfStencil = getInt(config, "halfStencil", 0) != 0;
+    settings.workStealing = getInt(config, "workStealing", 1) != 0;
+    settings.pinThreads = getInt(config, "pinThreads", 0) != 0;
+    settings.continuityDensity = getInt(config, "continuityDensity", 0) != 0;
+    settings.densityReinitInterval = int(getInt(
+        config, "densityReinitInterval", settings.densityReinitInterval));
+    settings.incrementalSort = getInt(config, "incrementalSort", 1) != 0;
+    settings.fullSortInterval = int(getInt(config, "fullSortInterval", 0));
+    settings.adaptiveTimeStep = getInt(config, "adaptiveTimeStep", 0) != 0;
+    settings.cflFactor = getFloat(config, "cflFactor", settings.cflFactor);
+    settings.forceFactor = getFloat(config, "forceFactor", settings.forceFactor);
+    settings.viscousFactor = getFloat(config, "viscousFactor", settings.viscousFactor);
+    settings.minTimeStep = getFloat(config, "minTimeStep", settings.minTimeStep);
+    settings.maxTimeStep = getFloat(config, "maxTimeStep", settings.maxTimeStep);
+    if (!parseCellOrder(getString(config, "cellOrder", "linear"), settings.cellOrder)
+        || !parseSimd(getString(config, "simd", "auto"), settings.simdLevel)) {
+        return 1;
+    }
+
+    const long cubeWidth = getInt(config, "cubeWidth", 15);
+    const long steps = getInt(config, "steps", 1000);
+    const float deltaTime = getFloat(config, "deltaTime", 0.003f);
+    const long threads = getInt(config, "threads", long(std::thread::hardware_concurrency()));
+    const std::string output = getString(config, "output", "");
+    const long outputEvery = getInt(config, "outputEvery", 100);
+    SurfaceSettings surface;
+    surface.resolution = int(getInt(config, "surfaceResolution", 0));
+    const std::string trace = getString(config, "trace", "");
+#ifndef SPH_PROFILE
+    if (!trace.empty()) {
+        std::fprintf(stderr, "trace needs a build with SPH_PROFILE\n");
+        return 1;
+    }
+#endif
+    if (cubeWidth < 1 || steps < 0 || threads < 1 || outputEvery < 1 || surface.resolution < 0
+        || settings.cellsPerRadius < 1) {
+        std::fprintf(stderr, "cubeWidth, threads, outputEvery and cellsPerRadius must be positive, steps and surfaceResolution must not be negative\n");
+        return 1;
+    }
+
+    SphSimulation simulation(size_t(cubeWidth), settings, false, size_t(threads));
+    std::printf("%s\n", simulation.getTopology().describe().c_str());
+    if (settings.adaptiveTimeStep) {
+        std::printf("%zu particles, %zu threads, %s kernels, %ld adaptive steps\n",
+            simulation.getParticleCount(), simulation.getThreadCount(),
+            getSimdLevelName(settings.simdLevel), steps);
+    }
+    else {
+        std::printf("%zu particles, %zu threads, %s kernels, %ld steps of %g s\n",
+            simulation.getParticleCount(), simulation.getThreadCount(),
+            getSimdLevelName(settings.simdLevel), steps, deltaTime);
+    }
+
+    if (!output.empty() && !writeSnapshot(output, 0, simulation.getParticles())) {
+        return 1;
+    }
+    SurfaceMesh surfaceMesh;
+    std::vector<double> idleSeconds(simulation.getThreadCount(), 0.0);
+    uint64_t sortedParticles = 0;
+    double stepSeconds = 0.0;
+    double surfaceSeconds = 0.0;
+    long surfaceCount = 0;
+    double simulatedTime = 0.0;
+    for (long step = 1; step <= steps; step++) {
+        auto start = std::chrono::steady_clock::now();
+        simulatedTime += simulation.step(deltaTime);
+        stepSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        for (size_t t = 0; t < idleSeconds.size(); t++) {
+            idleSeconds[t] += simulation.getThreadIdleTimes()[t];
+        }
+        sortedParticles += simulation.getNeighborStats().sortedParticles;
+
+        if (!output.empty() && (step % outputEvery == 0 || step == steps)
+            && !writeSnapshot(output, step, simulation.getParticles())) {
+            return 1;
+        }
+        if (!output.empty() && surface.resolution > 0 && (step % outputEvery == 0 || step == steps)) {
+            start = std::chrono::steady_clock::now();
+            simulation.extractSurface(surface, surfaceMesh);
+            surfaceSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            surfaceCount++;
+            if (!writeSurface(output, step, surfaceMesh)) {
+                return 1;
+            }
+        }
+    }
+
+    if (steps > 0) {
+        std::printf("%.3f s simulated in %.3f s, %.3f ms/step, %.1f M particle steps/s\n",
+            simulatedTime, stepSeconds, 1000.0 * stepSeconds / steps,
+            double(simulation.getParticleCount()) * steps / stepSeconds * 1e-6);
+        std::printf("%.1f particles sorted per step\n", double(sortedParticles) / steps);
+        if (settings.pinThreads && !simulation.areThreadsPinned()) {
+            std::printf("threads could not be pinned\n");
+        }
+        std::printf("idle ms/step per thread:");
+        for (double seconds : idleSeconds) {
+            std::printf(" %.3f", 1000.0 * seconds / steps);
+        }
+        std::printf("\n");
+    }
+    if (surfaceCount > 0) {
+        std::printf("%ld surfaces at %d voxels, %.3f ms/surface\n",
+            surfaceCount, surface.resolution, 1000.0 * surfaceSeconds / surfaceCount);
+    }
+
+#ifdef SPH_PROFILE
+    if (!trace.empty()) {
+        for (const ProfileZoneStats &zone : Profiler::get().collectStats()) {
+            std::printf("%*s%-*s %8llu x  min %.3f  mean %.3f  p99 %.3f ms\n",
+                int(zone.depth * 2), "", int(24 - zone.depth * 2), zone.name.c_str(),
+                (unsigned long long)zone.count, zone.minMs, zone.meanMs, zone.p99Ms);
+        }
+        if (!Profiler::get().exportChromeTrace(trace)) {
+            std::fprintf(stderr, "can't write %s\n", trace.c_str());
+            return 1;
+        }
+    }
+#endif
+    return 0;
+}
@@ -0,0 +1,61 @@
+#version 430 core
+in vec2 texCoord;
+
+uniform sampler2D depthMap;
+uniform sampler2D thicknessMap;
+uniform mat4 viewMtx=mat4(1);
+uniform mat4 projectionMtx=mat4(1);
+uniform vec2 texelSize=vec2(0);
+uniform vec3 LightDirection=normalize(vec3(-1,0,0));
+uniform vec3 LightColor=vec3(1.0, 1.0, 1.0);
+uniform vec3 FluidColor=vec3(0.0,0.5,0.9);
+uniform vec3 BackgroundColor=vec3(0.1,0.2,0.3);
+// extinction per unit of thickness
+uniform float Absorption=2.0;
+
+out vec4 finalColor;
+
+// View-space position of a pixel from its linear depth
+vec3 viewPositionAt(vec2 uv, float depth) {
+	vec2 ndc=uv * 2.0 - 1.0;
+	return vec3(ndc.x / projectionMtx[0][0], ndc.y / projectionMtx[1][1], -1.0) * depth;
+}
+
+void main() {
+	float depth=texture(depthMap,texCoord).r;
+	if (depth <= 0)
+		discard;
+	vec3 position=viewPositionAt(texCoord, depth);
+
+	// Normal from the smoothed depth; the smaller of both one-sided
+	// differences avoids smearing across silhouettes
+	vec3 ddx=viewPositionAt(texCoord + vec2(texelSize.x,0), texture(depthMap,texCoord + vec2(texelSize.x,0)).r) - position;
+	vec3 ddx2=position - viewPositionAt(texCoord - vec2(texelSize.x,0), texture(depthMap,texCoord - vec2(texelSize.x,0)).r);
+	if (abs(ddx2.z) < abs(ddx.z))
+		ddx=ddx2;
+	vec3 ddy=viewPositionAt(texCoord + vec2(0,texelSize.y), texture(depthMap,texCoord + vec2(0,texelSize.y)).r) - position;
+	vec3 ddy2=position - viewPositionAt(texCoord - vec2(0,texelSize.y), texture(depthMap,texCoord - vec2(0,texelSize.y)).r);
+	if (abs(ddy2.z) < abs(ddy.z))
+		ddy=ddy2;
+	vec3 viewNormal=normalize(cross(ddx,ddy));
+
+	// Lighting in world space like the particle shaders
+	mat3 viewToWorld=transpose(mat3(viewMtx));
+	vec3 normal=viewToWorld * viewNormal;
+	vec3 toEye=viewToWorld * normalize(-position);
+	float thickness=texture(thicknessMap,texCoord).r;
+
+	// Beer-Lambert: thin fluid lets the background through
+	vec3 transmission=exp(-Absorption * thickness * (vec3(1.0) - FluidColor));
+	vec3 refracted=mix(FluidColor, BackgroundColor, transmission);
+	vec3 diffuse=refracted * (vec3(0.3) + LightColor * max(0,dot(LightDirection,normal)));
+	vec3 halfway=normalize(LightDirection + toEye);
+	float specular=pow(max(dot(normal,halfway),0), 64.0);
+	float fresnel=0.02 + 0.98 * pow(1.0 - max(dot(normal,toEye),0), 5.0);
+
+	finalColor=vec4(mix(diffuse, LightColor, fresnel * 0.5) + specular * LightColor, 1);
+
+	vec4 clipPosition=projectionMtx * vec4(position,1);
+	gl_FragDepth=0.5 * (clipPosition.z / clipPosition.w) * (gl_DepthRange.far - gl_DepthRange.near)
+		+ 0.5 * (gl_DepthRange.far + gl_DepthRange.near);
+}
@@ -0,0 +1,26 @@
+#version 430 core
+in vec3 viewPosition;
+flat in vec3 viewCenter;
+flat in float fragValue;
+
+uniform mat4 projectionMtx=mat4(1);
+uniform float particleRadius=1.0;
+
+// linear eye distance along -z, 0 stays background
+out float viewDepth;
+
+void main() {
+	// Nearest intersection of the eye ray with the sphere, as in impostor.fs
+	vec3 rayDirection=normalize(viewPosition);
+	float b=dot(rayDirection,viewCenter);
+	float c=dot(viewCenter,viewCenter) - particleRadius * particleRadius;
+	float discriminant=b * b - c;
+	if (discriminant < 0)
+		discard;
+	vec3 hit=(b - sqrt(discriminant)) * rayDirection;
+
+	vec4 clipPosition=projectionMtx * vec4(hit,1);
+	gl_FragDepth=0.5 * (clipPosition.z / clipPosition.w) * (gl_DepthRange.far - gl_DepthRange.near)
+		+ 0.5 * (gl_DepthRange.far + gl_DepthRange.near);
+	viewDepth=-hit.z;
+}
@@ -0,0 +1,36 @@
+#version 430 core
+in vec2 texCoord;
+
+uniform sampler2D depthMap;
+// one texel along the filtered axis
+uniform vec2 texelStep=vec2(0);
+uniform int filterRadius=6;
+// 1 / depth difference at which a sample loses most of its weight
+uniform float depthFalloff=20.0;
+
+out float viewDepth;
+
+void main() {
+	float depth=texture(depthMap,texCoord).r;
+	if (depth <= 0) {
+		viewDepth=0;
+		return;
+	}
+
+	// Bilateral: spatial gaussian times a range term that keeps samples
+	// across a depth discontinuity from blurring the silhouettes
+	float sigma=max(float(filterRadius) * 0.5, 1.0);
+	float sum=0;
+	float weightSum=0;
+	for (int i=-filterRadius; i <= filterRadius; i++) {
+		float sampleDepth=texture(depthMap,texCoord + float(i) * texelStep).r;
+		if (sampleDepth <= 0)
+			continue;
+		float spatial=exp(-float(i * i) / (2.0 * sigma * sigma));
+		float range=(sampleDepth - depth) * depthFalloff;
+		float weight=spatial * exp(-range * range);
+		sum+=sampleDepth * weight;
+		weightSum+=weight;
+	}
+	viewDepth=sum / weightSum;
+}
@@ -0,0 +1,20 @@
+#version 430 core
+in vec3 viewPosition;
+flat in vec3 viewCenter;
+flat in float fragValue;
+
+uniform float particleRadius=1.0;
+
+// summed with additive blending
+out float thickness;
+
+void main() {
+	// Length of the eye ray inside the sphere
+	vec3 rayDirection=normalize(viewPosition);
+	float b=dot(rayDirection,viewCenter);
+	float c=dot(viewCenter,viewCenter) - particleRadius * particleRadius;
+	float discriminant=b * b - c;
+	if (discriminant < 0)
+		discard;
+	thickness=2.0 * sqrt(discriminant);
+}
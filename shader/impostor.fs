@@ -0,0 +1,42 @@
+#version 430 core
+in vec3 viewPosition;
+flat in vec3 viewCenter;
+flat in float fragValue;
+
+uniform mat4 viewMtx=mat4(1);
+uniform mat4 projectionMtx=mat4(1);
+uniform float particleRadius=1.0;
+uniform vec3 LightDirection=normalize(vec3(-1,0,0));
+uniform vec3 LightColor=vec3(1.0, 1.0, 1.0);
+uniform vec3 DiffuseColor=vec3(0.0,0.5,0.9);
+uniform vec3 HighValueColor=vec3(0.9,0.3,0.1);
+uniform int ColorByValue=0;
+
+out vec4 finalColor;
+
+void main() {
+	// Intersect the eye ray through this fragment with the sphere
+	vec3 rayDirection=normalize(viewPosition);
+	float b=dot(rayDirection,viewCenter);
+	float c=dot(viewCenter,viewCenter) - particleRadius * particleRadius;
+	float discriminant=b * b - c;
+	if (discriminant < 0)
+		discard;
+	vec3 hit=(b - sqrt(discriminant)) * rayDirection;
+
+	// Depth of the sphere surface instead of the quad
+	vec4 clipPosition=projectionMtx * vec4(hit,1);
+	gl_FragDepth=0.5 * (clipPosition.z / clipPosition.w) * (gl_DepthRange.far - gl_DepthRange.near)
+		+ 0.5 * (gl_DepthRange.far + gl_DepthRange.near);
+
+	// The view matrix is a rigid transform, its transpose turns the normal back to world space
+	vec3 normal=transpose(mat3(viewMtx)) * ((hit - viewCenter) / particleRadius);
+
+	// Blend towards HighValueColor with the normalized attribute value
+	vec3 diffuse= ColorByValue!=0 ? mix(DiffuseColor,HighValueColor,fragValue) : DiffuseColor;
+
+	// Compute irradiance (sum of ambient & direct lighting)
+	vec3 irradiance= vec3(0.3,0.3,0.3) * diffuse + diffuse * LightColor * max(0,dot(LightDirection,normalize(normal)));
+
+	finalColor=vec4(irradiance,1);
+}
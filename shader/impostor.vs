@@ -0,0 +1,23 @@
+#version 430 core
+layout(location=2) in vec4 Instance; // xyz position, w attribute value
+out vec3 viewPosition;
+flat out vec3 viewCenter;
+flat out float fragValue;
+uniform mat4 viewMtx=mat4(1);
+uniform mat4 projectionMtx=mat4(1);
+uniform float particleRadius=1.0;
+uniform vec2 valueRange=vec2(0,1);
+void main() {
+	// one quad per particle from gl_VertexID, drawn as a 4 vertex strip
+	vec2 corner=vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+	viewCenter=vec3(viewMtx * vec4(Instance.xyz,1));
+	// quad facing the eye, moved towards it by the radius: a square of
+	// half size radius there covers the whole silhouette of the sphere
+	vec3 toEye=-normalize(viewCenter);
+	vec3 side=cross(vec3(0,1,0), toEye);
+	vec3 right=dot(side,side) > 1e-8 ? normalize(side) : vec3(1,0,0);
+	vec3 up=cross(toEye, right);
+	viewPosition=viewCenter + particleRadius * (toEye + corner.x * right + corner.y * up);
+	fragValue=clamp((Instance.w - valueRange.x) / max(valueRange.y - valueRange.x, 1e-6), 0, 1);
+	gl_Position=projectionMtx * vec4(viewPosition,1);
+}
@@ -1,16 +1,22 @@
 #version 430 core
 in vec3 fragPosition;
 in vec3 fragNormal;
+in float fragValue;
 
 uniform vec3 LightDirection=normalize(vec3(-1,0,0));
 uniform vec3 LightColor=vec3(1.0, 1.0, 1.0);
 uniform vec3 DiffuseColor=vec3(0.0,0.5,0.9);
+uniform vec3 HighValueColor=vec3(0.9,0.3,0.1);
+uniform int ColorByValue=0;
 
 out vec4 finalColor;
 
 void main() {
+	// Blend towards HighValueColor with the normalized attribute value
+	vec3 diffuse= ColorByValue!=0 ? mix(DiffuseColor,HighValueColor,fragValue) : DiffuseColor;
+
 	// Compute irradiance (sum of ambient & direct lighting)
-	vec3 irradiance= vec3(0.3,0.3,0.3) * DiffuseColor + DiffuseColor * LightColor * max(0,dot(LightDirection,normalize(fragNormal)));
+	vec3 irradiance= vec3(0.3,0.3,0.3) * diffuse + diffuse * LightColor * max(0,dot(LightDirection,normalize(fragNormal)));
 	
 	// Gamma correction
 	finalColor=vec4(irradiance,1);
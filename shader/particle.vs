@@ -1,15 +1,17 @@
 #version 430 core
 layout(location=0) in vec3 Position;
 layout(location=1) in vec3 Normal;
-layout(location=2) in mat4 ModelMtx;
-
+layout(location=2) in vec4 Instance; // xyz position, w attribute value
 out vec3 fragPosition;
 out vec3 fragNormal;
-
+out float fragValue;
 uniform mat4 viewProjMtx=mat4(1);
-
+uniform float particleRadius=1.0;
+uniform vec2 valueRange=vec2(0,1);
 void main() {
-	gl_Position=viewProjMtx * ModelMtx * vec4(Position,1);
-	fragPosition=vec3(ModelMtx * vec4(Position,1));
-	fragNormal=vec3(ModelMtx * vec4(Normal,0));
-}
\ No newline at end of file
+	// the sphere is only scaled and translated, so the normal is unchanged
+	fragPosition=Instance.xyz + particleRadius * Position;
+	fragNormal=Normal;
+	fragValue=clamp((Instance.w - valueRange.x) / max(valueRange.y - valueRange.x, 1e-6), 0, 1);
+	gl_Position=viewProjMtx * vec4(fragPosition,1);
+}
@@ -0,0 +1,8 @@
+#version 430 core
+out vec2 texCoord;
+void main() {
+	// one triangle covering the screen, no vertex buffer
+	vec2 corner=vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	texCoord=corner;
+	gl_Position=vec4(corner * 2.0 - 1.0, 0, 1);
+}
@@ -10,10 +10,25 @@ BufferUPtr Buffer::CreateWithData(uint32_t bufferType, uint32_t usage, const voi
     return move(buffer);
 }
 
+BufferUPtr Buffer::CreatePersistent(uint32_t bufferType, size_t stride, size_t count)
+{
+    auto buffer = BufferUPtr(new Buffer());
+    if (!buffer->InitPersistent(bufferType, stride, count))
+    {
+        return nullptr;
+    }
+    return move(buffer);
+}
+
 Buffer::~Buffer()
 {
     if (m_buffer)
     {
+        if (m_mapped)
+        {
+            Bind();
+            glUnmapBuffer(m_bufferType);
+        }
         glDeleteBuffers(1, &m_buffer);
     }
 }
@@ -34,3 +49,23 @@ bool Buffer::Init(uint32_t bufferType, uint32_t usage, const void *data, size_t
     glBufferData(m_bufferType, m_count * m_stride, data, usage);
     return true;
 }
+
+bool Buffer::InitPersistent(uint32_t bufferType, size_t stride, size_t count)
+{
+    m_bufferType = bufferType;
+    m_stride = stride;
+    m_count = count;
+    glGenBuffers(1, &m_buffer);
+    Bind();
+    // coherent: writes become visible to commands issued after them
+    // without a flush
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(m_bufferType, m_count * m_stride, nullptr, flags);
+    m_mapped = glMapBufferRange(m_bufferType, 0, m_count * m_stride, flags);
+    if (!m_mapped)
+    {
+        SPDLOG_ERROR("failed to map persistent buffer of {} bytes", m_count * m_stride);
+        return false;
+    }
+    return true;
+}
@@ -8,11 +8,14 @@ class Buffer
 {
 public:
     static BufferUPtr CreateWithData(uint32_t bufferType, uint32_t usage, const void *data, size_t stride, size_t count);
+    // immutable storage that stays mapped for writing until destruction
+    static BufferUPtr CreatePersistent(uint32_t bufferType, size_t stride, size_t count);
     ~Buffer();
     uint32_t Get() const { return m_buffer; }
     size_t GetStride() const { return m_stride; }
     size_t GetCount() const { return m_count; }
     size_t GetSize() const{return m_stride*m_count;}
+    void *GetMapped() const { return m_mapped; }
     void Bind() const;
 
 private:
@@ -20,11 +23,13 @@ private:
     bool Init(
         uint32_t bufferType, uint32_t usage,
         const void* data, size_t stride, size_t count);
+    bool InitPersistent(uint32_t bufferType, size_t stride, size_t count);
     uint32_t m_buffer{0};
     uint32_t m_bufferType{0};
     uint32_t m_usage{0};
     size_t m_stride { 0 };
     size_t m_count { 0 };
+    void *m_mapped { nullptr };
 };
 
 #endif
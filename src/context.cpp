@@ -1,6 +1,7 @@
 #include "context.h"
 #include "image.h"
 #include <imgui.h>
+#include <algorithm>
 
 Context::~Context()
 {
@@ -23,6 +24,14 @@ void Context::Reshape(int width, int height)
     glViewport(0, 0, m_width, m_height);
 
     m_framebuffer = Framebuffer::Create(Texture::Create(width, height, GL_RGBA));
+
+    // fluid targets hold one float per pixel, sampled texel by texel
+    for (FramebufferUPtr *target : {&m_fluidDepth, &m_fluidSmooth, &m_fluidThickness})
+    {
+        TexturePtr texture = Texture::Create(width, height, GL_RED, GL_FLOAT);
+        texture->SetFilter(GL_NEAREST, GL_NEAREST);
+        *target = Framebuffer::Create(texture);
+    }
 }
 void Context::MouseMove(double x, double y)
 {
@@ -81,6 +90,17 @@ bool Context::Init()
     m_particles = Program::Create("../../shader/particle.vs", "../../shader/particle.fs");
     if(!m_particles)
         return false;
+    m_impostors = Program::Create("../../shader/impostor.vs", "../../shader/impostor.fs");
+    if(!m_impostors)
+        return false;
+    m_fluidDepthProgram = Program::Create("../../shader/impostor.vs", "../../shader/fluid_depth.fs");
+    m_fluidThicknessProgram = Program::Create("../../shader/impostor.vs", "../../shader/fluid_thickness.fs");
+    m_fluidSmoothProgram = Program::Create("../../shader/screen.vs", "../../shader/fluid_smooth.fs");
+    m_fluidCompositeProgram = Program::Create("../../shader/screen.vs", "../../shader/fluid_composite.fs");
+    if (!m_fluidDepthProgram || !m_fluidThicknessProgram || !m_fluidSmoothProgram || !m_fluidCompositeProgram)
+        return false;
+    m_screenLayout = VertexLayout::Create();
+    glBindVertexArray(0);
 
     //load objs
     m_lightbox=Mesh::CreateBox();
@@ -91,6 +111,7 @@ bool Context::Init()
 }
 void Context::Render()
 {
+    SPH_PROFILE_ZONE("frame");
     if (ImGui::Begin("ui window")) {
         ImGui::DragFloat3("camera pos", glm::value_ptr(m_cameraPos), 0.01f);
         ImGui::DragFloat("camera yaw", &m_cameraYaw, 0.5f);
@@ -101,9 +122,103 @@ void Context::Render()
             m_cameraPitch = 0.0f;
             m_cameraPos = glm::vec3(0.0f, 0.0f, 3.0f);
         }
+        ImGui::Separator();
+        SPHSettings &sphSettings = m_sphSystem->getSettings();
+        ImGui::Checkbox("verlet lists", &sphSettings.useNeighborList);
+        ImGui::DragFloat("verlet skin", &sphSettings.neighborSkin, 0.001f, 0.001f, sphSettings.h);
+        bool mortonOrder = sphSettings.cellOrder == CellOrder::Morton;
+        if (ImGui::Checkbox("morton order", &mortonOrder)) {
+            sphSettings.cellOrder = mortonOrder ? CellOrder::Morton : CellOrder::Linear;
+        }
+        ImGui::SliderInt("cells per radius", &sphSettings.cellsPerRadius, 1, 3);
+        const char *simdLevels[] = {
+            getSimdLevelName(SimdLevel::Scalar), getSimdLevelName(SimdLevel::Sse),
+            getSimdLevelName(SimdLevel::Avx2), getSimdLevelName(SimdLevel::Avx512)};
+        int simdLevel = int(sphSettings.simdLevel);
+        if (ImGui::Combo("simd kernels", &simdLevel, simdLevels, int(detectSimdLevel()) + 1)) {
+            sphSettings.simdLevel = SimdLevel(simdLevel);
+        }
+        ImGui::Checkbox("half stencil forces", &sphSettings.halfStencil);
+        ImGui::Checkbox("continuity density", &sphSettings.continuityDensity);
+        if (sphSettings.continuityDensity) {
+            ImGui::SliderInt("density reinit interval", &sphSettings.densityReinitInterval, 0, 100);
+        }
+        ImGui::Checkbox("work stealing", &sphSettings.workStealing);
+        ImGui::Checkbox("pin threads", &sphSettings.pinThreads);
+        ImGui::Checkbox("incremental sort", &sphSettings.incrementalSort);
+        if (sphSettings.incrementalSort) {
+            ImGui::SliderInt("full sort interval", &sphSettings.fullSortInterval, 0, 64);
+        }
+        const char *renderModes[] = {"impostors", "meshes", "fluid surface"};
+        int renderMode = int(m_sphSystem->getRenderMode());
+        if (ImGui::Combo("particles", &renderMode, renderModes, 3)) {
+            m_sphSystem->getRenderMode() = ParticleRenderMode(renderMode);
+        }
+        if (m_sphSystem->getRenderMode() == ParticleRenderMode::Fluid) {
+            ImGui::SliderInt("smoothing iterations", &m_fluidSmoothIterations, 0, 8);
+            ImGui::SliderInt("smoothing radius (px)", &m_fluidFilterRadius, 1, 20);
+            ImGui::DragFloat("depth falloff", &m_fluidDepthFalloff, 0.5f, 0.0f, 200.0f);
+            ImGui::DragFloat("absorption", &m_fluidAbsorption, 0.05f, 0.0f, 20.0f);
+        }
+        const char *instanceAttributes[] = {"none", "density", "pressure", "speed"};
+        int instanceAttribute = int(sphSettings.instanceAttribute);
+        if (ImGui::Combo("color by", &instanceAttribute, instanceAttributes, 4)) {
+            sphSettings.instanceAttribute = InstanceAttribute(instanceAttribute);
+        }
+        ImGui::Checkbox("adaptive time step", &sphSettings.adaptiveTimeStep);
+        float frameBudgetMs = sphSettings.frameBudget * 1000.0f;
+        if (ImGui::DragFloat("frame budget (ms)", &frameBudgetMs, 0.1f, 0.0f, 100.0f)) {
+            sphSettings.frameBudget = frameBudgetMs / 1000.0f;
+        }
+        ImGui::Text("time step: %.5f s", m_sphSystem->getLastTimeStep());
+        ImGui::Text("simulation steps: %llu", (unsigned long long)m_sphSystem->getStepCount());
+        const NeighborStats &neighborStats = m_sphSystem->getNeighborStats();
+        ImGui::Text("candidate pairs: %llu", (unsigned long long)neighborStats.candidatePairs);
+        ImGui::Text("neighbor pairs: %llu", (unsigned long long)neighborStats.neighborPairs);
+        ImGui::Text("sorted particles: %llu", (unsigned long long)neighborStats.sortedParticles);
+        if (neighborStats.candidatePairs > 0) {
+            ImGui::Text("neighbor ratio: %.3f",
+                (double)neighborStats.neighborPairs / (double)neighborStats.candidatePairs);
+        }
+        const std::vector<double> &idleTimes = m_sphSystem->getThreadIdleTimes();
+        for (size_t t = 0; t < idleTimes.size(); t++) {
+            ImGui::Text("thread %zu idle: %.3f ms", t, idleTimes[t] * 1000.0);
+        }
     }
     ImGui::End();
 
+#ifdef SPH_PROFILE
+    if (ImGui::Begin("profiler")) {
+        if (m_profileFrame++ % 30 == 0) {
+            m_profileStats = Profiler::get().collectStats();
+        }
+        ImGui::Text("%-24s %8s %9s %9s %9s", "zone", "count", "min ms", "mean ms", "p99 ms");
+        ImGui::Separator();
+        for (const ProfileZoneStats &zone : m_profileStats) {
+            ImGui::Text("%*s%-*s %8llu %9.3f %9.3f %9.3f",
+                int(zone.depth * 2), "", int(24 - std::min(zone.depth * 2, 24u)),
+                zone.name.c_str(), (unsigned long long)zone.count,
+                zone.minMs, zone.meanMs, zone.p99Ms);
+        }
+        ImGui::Separator();
+        if (ImGui::Button("clear")) {
+            Profiler::get().clear();
+            m_profileStats.clear();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("export trace")) {
+            const char *tracePath = "sph_trace.json";
+            m_traceStatus = Profiler::get().exportChromeTrace(tracePath)
+                ? std::string("wrote ") + tracePath
+                : std::string("failed to write ") + tracePath;
+        }
+        if (!m_traceStatus.empty()) {
+            ImGui::Text("%s", m_traceStatus.c_str());
+        }
+    }
+    ImGui::End();
+#endif
+
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glViewport(0, 0, m_width, m_height);
 
@@ -117,7 +232,76 @@ void Context::Render()
     auto projection = glm::perspective(glm::radians(45.0f), (float)(m_width / m_height), 0.01f, 100.0f);
     //sph system
     m_sphSystem->update(0.003f);
-    m_sphSystem->draw(projection*view,m_particles.get());
+    if (m_sphSystem->getRenderMode() == ParticleRenderMode::Fluid)
+    {
+        RenderFluid(view, projection);
+    }
+    else
+    {
+        Program *particleProgram = m_sphSystem->getRenderMode() == ParticleRenderMode::Impostor
+            ? m_impostors.get() : m_particles.get();
+        m_sphSystem->draw(view, projection, particleProgram);
+    }
+}
+
+void Context::RenderFluid(const glm::mat4 &view, const glm::mat4 &projection)
+{
+    // depth pass: nearest sphere surface, 0 where there is no fluid
+    m_fluidDepth->Bind();
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    m_sphSystem->draw(view, projection, m_fluidDepthProgram.get());
+
+    // thickness pass: every sphere along the eye ray adds up, unoccluded
+    m_fluidThickness->Bind();
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    m_sphSystem->draw(view, projection, m_fluidThicknessProgram.get());
+    glDisable(GL_BLEND);
+
+    // smoothing: separable bilateral filter, ping-ponging the depth
+    // through m_fluidSmooth so the result ends up in m_fluidDepth again
+    glm::vec2 texelSize(1.0f / m_width, 1.0f / m_height);
+    m_screenLayout->Bind();
+    m_fluidSmoothProgram->Use();
+    m_fluidSmoothProgram->SetUniform("depthMap", 0);
+    m_fluidSmoothProgram->SetUniform("filterRadius", m_fluidFilterRadius);
+    m_fluidSmoothProgram->SetUniform("depthFalloff", m_fluidDepthFalloff);
+    glActiveTexture(GL_TEXTURE0);
+    for (int i = 0; i < m_fluidSmoothIterations; i++)
+    {
+        m_fluidSmooth->Bind();
+        m_fluidDepth->GetColorAttachment()->Bind();
+        m_fluidSmoothProgram->SetUniform("texelStep", glm::vec2(texelSize.x, 0.0f));
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        m_fluidDepth->Bind();
+        m_fluidSmooth->GetColorAttachment()->Bind();
+        m_fluidSmoothProgram->SetUniform("texelStep", glm::vec2(0.0f, texelSize.y));
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    // composite: shade the smoothed surface into the window, with depth
+    Framebuffer::BindToDefault();
+    glClearColor(m_clearColor.r, m_clearColor.g, m_clearColor.b, m_clearColor.a);
+    glEnable(GL_DEPTH_TEST);
+    m_fluidCompositeProgram->Use();
+    m_fluidCompositeProgram->SetUniform("depthMap", 0);
+    m_fluidCompositeProgram->SetUniform("thicknessMap", 1);
+    m_fluidCompositeProgram->SetUniform("viewMtx", view);
+    m_fluidCompositeProgram->SetUniform("projectionMtx", projection);
+    m_fluidCompositeProgram->SetUniform("texelSize", texelSize);
+    m_fluidCompositeProgram->SetUniform("BackgroundColor", glm::vec3(m_clearColor));
+    m_fluidCompositeProgram->SetUniform("Absorption", m_fluidAbsorption);
+    glActiveTexture(GL_TEXTURE0);
+    m_fluidDepth->GetColorAttachment()->Bind();
+    glActiveTexture(GL_TEXTURE1);
+    m_fluidThickness->GetColorAttachment()->Bind();
+    glActiveTexture(GL_TEXTURE0);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
 }
 
 void Context::ProcessInput(GLFWwindow *window)
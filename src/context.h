@@ -13,6 +13,7 @@
 #include "shadow_map.h"
 #include <time.h>
 #include "sphSystem.h"
+#include "profiler.h"
 
 CLASS_PTR(Context)
 
@@ -30,11 +31,18 @@ class Context
   private:
     Context(){};
     bool Init();
+    // screen-space fluid surface: depth, smoothing, thickness, composite
+    void RenderFluid(const glm::mat4 &view, const glm::mat4 &projection);
 
     //programs
     ProgramUPtr m_program;
     ProgramUPtr m_simpleProgram;
     ProgramUPtr m_particles;
+    ProgramUPtr m_impostors;
+    ProgramUPtr m_fluidDepthProgram;
+    ProgramUPtr m_fluidThicknessProgram;
+    ProgramUPtr m_fluidSmoothProgram;
+    ProgramUPtr m_fluidCompositeProgram;
     
     float m_gamma {1.0f};
 
@@ -51,6 +59,18 @@ class Context
     float m_cameraYaw{0.0f};
     // framebuffer
     FramebufferUPtr m_framebuffer;
+    // fluid render targets, window sized: linear eye depth (smoothed in
+    // place), the other half of the smoothing ping-pong and thickness
+    FramebufferUPtr m_fluidDepth;
+    FramebufferUPtr m_fluidSmooth;
+    FramebufferUPtr m_fluidThickness;
+    // empty layout for the full screen passes
+    VertexLayoutUPtr m_screenLayout;
+    // fluid parameters
+    int m_fluidSmoothIterations{2};
+    int m_fluidFilterRadius{8};
+    float m_fluidDepthFalloff{20.0f};
+    float m_fluidAbsorption{2.0f};
     
     // clear color
     glm::vec4 m_clearColor{glm::vec4(0.1f, 0.2f, 0.3f, 0.0f)};
@@ -72,6 +92,12 @@ class Context
     SphSystem* m_sphSystem;
     
     bool m_blinn{true};
+#ifdef SPH_PROFILE
+    // profiler panel, refreshed every few frames
+    std::vector<ProfileZoneStats> m_profileStats;
+    int m_profileFrame{0};
+    std::string m_traceStatus;
+#endif
     int m_width{1920};
     int m_height{1080};
 };
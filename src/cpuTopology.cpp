@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "cpuTopology.h"
+
+namespace {
+
+#ifdef __linux__
+/// Parses a kernel CPU list like "0-3,8,10-11".
+std::vector<int> parseCpuList(const std::string &text)
+{
+    std::vector<int> cpus;
+    std::stringstream stream(text);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        int first, last;
+        int fields = std::sscanf(range.c_str(), "%d-%d", &first, &last);
+        if (fields == 1) {
+            last = first;
+        }
+        else if (fields != 2) {
+            continue;
+        }
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+uint64_t readNodeMemory(int node)
+{
+    std::ifstream file(
+        "/sys/devices/system/node/node" + std::to_string(node) + "/meminfo");
+    std::string line;
+    while (std::getline(file, line)) {
+        unsigned long long kilobytes;
+        // "Node 0 MemTotal:       65776556 kB"
+        size_t field = line.find("MemTotal:");
+        if (field != std::string::npos
+            && std::sscanf(line.c_str() + field, "MemTotal: %llu", &kilobytes) == 1) {
+            return uint64_t(kilobytes) * 1024;
+        }
+    }
+    return 0;
+}
+#endif
+
+/// Formats CPUs back into a list like "0-3,8,10-11".
+std::string formatCpuList(const std::vector<int> &cpus)
+{
+    std::string text;
+    for (size_t i = 0; i < cpus.size();) {
+        size_t last = i;
+        while (last + 1 < cpus.size() && cpus[last + 1] == cpus[last] + 1) {
+            last++;
+        }
+        if (!text.empty()) {
+            text += ",";
+        }
+        text += std::to_string(cpus[i]);
+        if (last > i) {
+            text += "-" + std::to_string(cpus[last]);
+        }
+        i = last + 1;
+    }
+    return text;
+}
+
+}
+
+CpuTopology CpuTopology::detect()
+{
+    CpuTopology topology;
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool hasMask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string nodeList;
+    if (std::getline(online, nodeList)) {
+        for (int id : parseCpuList(nodeList)) {
+            std::ifstream cpuFile(
+                "/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+            std::string cpuList;
+            std::getline(cpuFile, cpuList);
+            Node node;
+            node.id = id;
+            for (int cpu : parseCpuList(cpuList)) {
+                if (!hasMask || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))) {
+                    node.cpus.push_back(cpu);
+                }
+            }
+            node.memoryBytes = readNodeMemory(id);
+            // Memory-only nodes have nothing to pin to
+            if (!node.cpus.empty()) {
+                topology.nodes.push_back(node);
+            }
+        }
+    }
+    if (topology.nodes.empty() && hasMask) {
+        Node node;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                node.cpus.push_back(cpu);
+            }
+        }
+        if (!node.cpus.empty()) {
+            topology.nodes.push_back(node);
+        }
+    }
+#endif
+    if (topology.nodes.empty()) {
+        Node node;
+        for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++) {
+            node.cpus.push_back(int(cpu));
+        }
+        topology.nodes.push_back(node);
+    }
+    return topology;
+}
+
+size_t CpuTopology::getCpuCount() const
+{
+    size_t count = 0;
+    for (const Node &node : nodes) {
+        count += node.cpus.size();
+    }
+    return count;
+}
+
+std::vector<int> CpuTopology::getPinOrder() const
+{
+    std::vector<int> cpus;
+    for (const Node &node : nodes) {
+        cpus.insert(cpus.end(), node.cpus.begin(), node.cpus.end());
+    }
+    return cpus;
+}
+
+std::string CpuTopology::describe() const
+{
+    std::string text = std::to_string(nodes.size()) + " NUMA node"
+        + (nodes.size() == 1 ? "" : "s") + ", "
+        + std::to_string(getCpuCount()) + " CPUs";
+    for (const Node &node : nodes) {
+        text += "\n  node " + std::to_string(node.id) + ": CPUs "
+            + formatCpuList(node.cpus);
+        if (node.memoryBytes > 0) {
+            char memory[32];
+            std::snprintf(memory, sizeof(memory), ", %.1f GiB",
+                double(node.memoryBytes) / (1024.0 * 1024.0 * 1024.0));
+            text += memory;
+        }
+    }
+    return text;
+}
@@ -0,0 +1,35 @@
+#ifndef SPH_CPU_TOPOLOGY_H
+#define SPH_CPU_TOPOLOGY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// \struct CpuTopology
+///
+/// NUMA nodes and the CPUs of each that this process may run on. Read from
+/// /sys/devices/system/node on Linux; elsewhere, or where that is missing,
+/// all hardware threads make up a single node.
+struct CpuTopology
+{
+    struct Node
+    {
+        int id{0};
+        std::vector<int> cpus;
+        // 0 where unknown
+        uint64_t memoryBytes{0};
+    };
+
+    std::vector<Node> nodes;
+
+    static CpuTopology detect();
+
+    size_t getCpuCount() const;
+    /// Every CPU once, node by node, so consecutive workers, which own
+    /// consecutive particle blocks, share a node.
+    std::vector<int> getPinOrder() const;
+    /// One line per node for the startup report.
+    std::string describe() const;
+};
+
+#endif // SPH_CPU_TOPOLOGY_H
@@ -104,4 +104,11 @@ MeshUPtr Mesh::CreatePlane() {
   };
 
   return Create(vertices, indices, GL_TRIANGLES);
-}
\ No newline at end of file
+}
+MeshUPtr Mesh::CreateFromSurface(const SurfaceMesh& surface) {
+  std::vector<Vertex> vertices(surface.positions.size());
+  for (size_t i = 0; i < vertices.size(); i++) {
+    vertices[i] = Vertex { surface.positions[i], surface.normals[i], glm::vec2(0.0f) };
+  }
+  return Create(vertices, surface.indices, GL_TRIANGLES);
+}
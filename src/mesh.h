@@ -6,6 +6,7 @@
 #include "vertex_layout.h"
 #include "texture.h"
 #include "program.h"
+#include "surfaceExtractor.h"
 
 struct Vertex {
     glm::vec3 position;
@@ -35,6 +36,7 @@ public:
   static MeshUPtr Create(const std::vector<Vertex>& vertices,const std::vector<uint32_t>& indices, uint32_t primitiveType);
   static MeshUPtr CreateBox();
   static MeshUPtr CreatePlane();
+  static MeshUPtr CreateFromSurface(const SurfaceMesh& surface);
 
   const VertexLayout* GetVertexLayout() const {
     return m_vertexLayout.get();
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cstdlib>
+#include "neighborGrid.h"
+
+namespace {
+// Upper bound of the cell tables; particles flying far off make the
+// domain smaller rather than the tables huge.
+const uint64_t MAX_CELL_COUNT = 1 << 22;
+
+// Bits needed to store coordinates 0 .. size - 1
+int coordinateBits(int size)
+{
+    int bits = 0;
+    while ((1 << bits) < size) {
+        bits++;
+    }
+    return bits;
+}
+
+uint64_t keyCountOf(const glm::ivec3 &dims, CellOrder order)
+{
+    if (order == CellOrder::Morton) {
+        return uint64_t(1) << (coordinateBits(dims.x) + coordinateBits(dims.y)
+            + coordinateBits(dims.z));
+    }
+    return uint64_t(dims.x) * uint64_t(dims.y) * uint64_t(dims.z);
+}
+}
+
+void CellDomain::updateKeys()
+{
+    for (int axis = 0; axis < 3; axis++) {
+        axisKeys[axis].resize(dims[axis]);
+    }
+
+    if (order == CellOrder::Linear) {
+        uint32_t stride = 1;
+        for (int axis = 0; axis < 3; axis++) {
+            for (int c = 0; c < dims[axis]; c++) {
+                axisKeys[axis][c] = uint32_t(c) * stride;
+            }
+            stride *= uint32_t(dims[axis]);
+        }
+        keyCount = stride;
+        return;
+    }
+
+    // Interleave bit by bit; an axis that ran out of bits drops out, so
+    // flat domains do not pay for the key space of a cube.
+    glm::ivec3 bits(
+        coordinateBits(dims.x), coordinateBits(dims.y), coordinateBits(dims.z));
+    for (int axis = 0; axis < 3; axis++) {
+        std::fill(axisKeys[axis].begin(), axisKeys[axis].end(), 0);
+    }
+    uint32_t keyBit = 0;
+    for (int bit = 0; bit < 32; bit++) {
+        for (int axis = 0; axis < 3; axis++) {
+            if (bit >= bits[axis]) {
+                continue;
+            }
+            for (int c = 0; c < dims[axis]; c++) {
+                axisKeys[axis][c] |= uint32_t((c >> bit) & 1) << keyBit;
+            }
+            keyBit++;
+        }
+    }
+    keyCount = uint32_t(1) << keyBit;
+}
+
+void CellStencil::build(int cellsPerRadius)
+{
+    this->cellsPerRadius = cellsPerRadius;
+    offsets.clear();
+    halfOffsets.clear();
+    const int reach = cellsPerRadius;
+    for (int z = -reach; z <= reach; z++) {
+        for (int y = -reach; y <= reach; y++) {
+            for (int x = -reach; x <= reach; x++) {
+                // Whole cells between the own cell and this one per axis.
+                // A gap of exactly the radius is kept, a particle on a
+                // cell border may round into either cell.
+                int gapX = std::max(std::abs(x) - 1, 0);
+                int gapY = std::max(std::abs(y) - 1, 0);
+                int gapZ = std::max(std::abs(z) - 1, 0);
+                if (gapX * gapX + gapY * gapY + gapZ * gapZ
+                    > cellsPerRadius * cellsPerRadius) {
+                    continue;
+                }
+                offsets.push_back(glm::ivec3(x, y, z));
+                if (z > 0 || (z == 0 && (y > 0 || (y == 0 && x > 0)))) {
+                    halfOffsets.push_back(glm::ivec3(x, y, z));
+                }
+            }
+        }
+    }
+}
+
+void NeighborGrid::setDomain(
+    const glm::vec3 &lower, const glm::vec3 &upper, float cellSize,
+    CellOrder order, int cellsPerRadius)
+{
+    if (stencil.offsets.empty() || stencil.cellsPerRadius != cellsPerRadius) {
+        stencil.build(cellsPerRadius);
+    }
+    domain.cellSize = cellSize;
+    domain.invCellSize = 1.0f / cellSize;
+    domain.order = order;
+    // One cell of padding absorbs the motion of the step the domain lags
+    for (int axis = 0; axis < 3; axis++) {
+        int minCell = int(std::floor(lower[axis] * domain.invCellSize)) - 1;
+        int maxCell = int(std::floor(upper[axis] * domain.invCellSize)) + 1;
+        domain.minCell[axis] = minCell;
+        domain.dims[axis] = maxCell - minCell + 1;
+    }
+    const glm::ivec3 &dims = domain.dims;
+    while (keyCountOf(dims, order) > MAX_CELL_COUNT) {
+        int axis = dims.x >= dims.y && dims.x >= dims.z ? 0 : (dims.y >= dims.z ? 1 : 2);
+        domain.dims[axis] = (domain.dims[axis] + 1) / 2;
+    }
+    domain.updateKeys();
+    domainValid = true;
+    indexValid = false;
+}
+
+void NeighborGrid::build(
+    ThreadPool &threadPool, const uint32_t *sortedKeys, size_t count)
+{
+    const size_t threadCount = threadPool.size();
+    blockOffsets.resize(threadCount + 1);
+    if (occupiedCells.size() < count) {
+        occupiedCells.resize(count);
+    }
+
+    // The tables span the cell domain. Growing keeps the old cells, which
+    // are cleared below like any other.
+    size_t keyCount = domain.getKeyCount();
+    if (cellStarts.size() < keyCount) {
+        cellStarts.resize(keyCount, 0);
+        cellEnds.resize(keyCount, 0);
+    }
+
+    // Clear the cells of the previous build and count the cells of this one
+    threadPool.run([&](size_t threadIndex, size_t threadCount) {
+        size_t start, end;
+        ThreadPool::blockRange(
+            occupiedCount, threadIndex, threadCount, start, end);
+        for (size_t i = start; i < end; i++) {
+            cellStarts[occupiedCells[i]] = 0;
+            cellEnds[occupiedCells[i]] = 0;
+        }
+
+        ThreadPool::blockRange(count, threadIndex, threadCount, start, end);
+        size_t cells = 0;
+        for (size_t i = start; i < end; i++) {
+            if (i == 0 || sortedKeys[i] != sortedKeys[i - 1]) {
+                cells++;
+            }
+        }
+        blockOffsets[threadIndex + 1] = cells;
+    });
+
+    blockOffsets[0] = 0;
+    for (size_t t = 0; t < threadCount; t++) {
+        blockOffsets[t + 1] += blockOffsets[t];
+    }
+    occupiedCount = blockOffsets[threadCount];
+
+    // Every cell boundary is owned by exactly one block
+    threadPool.run([&](size_t threadIndex, size_t threadCount) {
+        size_t start, end;
+        ThreadPool::blockRange(count, threadIndex, threadCount, start, end);
+        size_t slot = blockOffsets[threadIndex];
+        for (size_t i = start; i < end; i++) {
+            uint32_t key = sortedKeys[i];
+            if (i == 0 || key != sortedKeys[i - 1]) {
+                cellStarts[key] = uint32_t(i);
+                if (i > 0) {
+                    cellEnds[sortedKeys[i - 1]] = uint32_t(i);
+                }
+                occupiedCells[slot++] = key;
+            }
+        }
+        if (end == count && start < end) {
+            cellEnds[sortedKeys[count - 1]] = uint32_t(count);
+        }
+    });
+    indexValid = true;
+}
@@ -0,0 +1,183 @@
+#ifndef SPH_NEIGHBOR_GRID_H
+#define SPH_NEIGHBOR_GRID_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "threadPool.h"
+
+/// Memory order of the cells, and so of the particles sorted by cell key.
+enum class CellOrder
+{
+    /// x runs fastest, then y, then z.
+    Linear,
+    /// Z-order curve: the bits of the cell coordinates are interleaved, so
+    /// cells close in space are close in memory along every axis.
+    Morton,
+};
+
+/// \struct CellDomain
+///
+/// Bounded box of cells that cell keys are computed over, so every cell has
+/// its own key and no two cells alias. Positions outside the box are
+/// clamped onto its border. Clamping keeps neighbouring cells adjacent, so
+/// a domain that lags behind the particles never loses a neighbour, it only
+/// puts more candidates into the border cells.
+///
+/// A key is the sum of one table entry per axis, which covers the linear
+/// and the Morton order with the same lookup.
+struct CellDomain
+{
+    glm::ivec3 minCell{0};
+    glm::ivec3 dims{1};
+    float cellSize{1.0f};
+    float invCellSize{1.0f};
+    CellOrder order{CellOrder::Linear};
+    // key contribution of every cell coordinate, per axis
+    std::vector<uint32_t> axisKeys[3];
+    uint32_t keyCount{1};
+
+    /// Fills the key tables for the current dims and order.
+    void updateKeys();
+
+    /// Cell of a position relative to minCell, clamped into the domain.
+    glm::ivec3 getCell(const glm::vec3 &position) const
+    {
+        glm::ivec3 cell;
+        for (int axis = 0; axis < 3; axis++) {
+            int c = int(std::floor(position[axis] * invCellSize)) - minCell[axis];
+            cell[axis] = c < 0 ? 0 : (c >= dims[axis] ? dims[axis] - 1 : c);
+        }
+        return cell;
+    }
+
+    bool contains(const glm::ivec3 &cell) const
+    {
+        return cell.x >= 0 && cell.y >= 0 && cell.z >= 0
+            && cell.x < dims.x && cell.y < dims.y && cell.z < dims.z;
+    }
+
+    /// Whether the box [lower, upper] lies inside the domain, unclamped.
+    bool containsBounds(const glm::vec3 &lower, const glm::vec3 &upper) const
+    {
+        for (int axis = 0; axis < 3; axis++) {
+            int low = int(std::floor(lower[axis] * invCellSize)) - minCell[axis];
+            int high = int(std::floor(upper[axis] * invCellSize)) - minCell[axis];
+            if (low < 0 || high >= dims[axis]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// Whether the domain has more than twice the cells a domain fitted
+    /// to [lower, upper] would have.
+    bool isOversized(const glm::vec3 &lower, const glm::vec3 &upper) const
+    {
+        uint64_t fittedCells = 1;
+        for (int axis = 0; axis < 3; axis++) {
+            // NeighborGrid::setDomain pads one cell on either side
+            fittedCells *= uint64_t(int(std::floor(upper[axis] * invCellSize))
+                - int(std::floor(lower[axis] * invCellSize)) + 3);
+        }
+        return 2 * fittedCells < uint64_t(dims.x) * uint64_t(dims.y) * uint64_t(dims.z);
+    }
+
+    /// Key of a cell inside the domain.
+    uint32_t getKey(const glm::ivec3 &cell) const
+    {
+        return axisKeys[0][cell.x] + axisKeys[1][cell.y] + axisKeys[2][cell.z];
+    }
+
+    /// Number of keys, i.e. one past the largest key. Morton keys leave
+    /// gaps, so this can exceed the number of cells.
+    uint32_t getKeyCount() const { return keyCount; }
+};
+
+/// Pair counts of a neighbour search, to see how many distance tests
+/// actually found a neighbour, and the particles its sort had to place.
+struct NeighborStats
+{
+    uint64_t candidatePairs{0};
+    uint64_t neighborPairs{0};
+    // movers of an incremental sort, every particle after a full one and
+    // none without a sort
+    uint64_t sortedParticles{0};
+};
+
+/// \struct CellStencil
+///
+/// Offsets of the cells a search of some radius visits around a particle's
+/// cell, for cells cellsPerRadius times smaller than that radius. Cells
+/// whose nearest point is farther than the radius from all of the own cell
+/// are pruned. Finer cells fit the support sphere more tightly: 27 cells
+/// spanning 27 radius^3 at 1, 125 spanning 15.6 radius^3 at 2 and 335,
+/// 7 x 7 x 7 without the corners, at 3, against the 4.19 radius^3 of the
+/// sphere itself.
+struct CellStencil
+{
+    int cellsPerRadius{1};
+    // z slowest and x fastest, as in the linear order, so cells adjacent
+    // in memory come one after another
+    std::vector<glm::ivec3> offsets;
+    // the offsets after the own cell in that order: every unordered pair
+    // of cells is visited from exactly one side, and z never goes
+    // backwards
+    std::vector<glm::ivec3> halfOffsets;
+
+    void build(int cellsPerRadius);
+    /// Cells the stencil reaches along every axis.
+    int getReach() const { return cellsPerRadius; }
+};
+
+/// \class NeighborGrid
+///
+/// Cell index over particles sorted by cell key: every key maps to the
+/// [start, end) range of particles in that cell, empty cells map to an
+/// empty range. The tables are sized to the cell domain, persist across
+/// steps and a rebuild only resets the cells filled by the previous build.
+class NeighborGrid
+{
+public:
+    /// Fits the cell domain around the bounds of the particles, for a
+    /// search radius of cellsPerRadius cells.
+    void setDomain(
+        const glm::vec3 &lower, const glm::vec3 &upper, float cellSize,
+        CellOrder order, int cellsPerRadius);
+    /// Forgets the domain, e.g. after the particles were re-initialized.
+    void clearDomain() { domainValid = false; indexValid = false; }
+    bool hasDomain() const { return domainValid; }
+    /// Whether build() ran since the domain was last set, so the index
+    /// still holds the keys of the current domain for the particle order
+    /// it was built for.
+    bool hasIndex() const { return indexValid; }
+    const CellDomain &getDomain() const { return domain; }
+    const CellStencil &getStencil() const { return stencil; }
+
+    /// Rebuilds the index in parallel from keys sorted ascending.
+    void build(
+        ThreadPool &threadPool, const uint32_t *sortedKeys, size_t count);
+
+    const uint32_t *getCellStarts() const { return cellStarts.data(); }
+    const uint32_t *getCellEnds() const { return cellEnds.data(); }
+
+    /// Keys of the non-empty cells in ascending order.
+    const uint32_t *getOccupiedCells() const { return occupiedCells.data(); }
+    size_t getOccupiedCount() const { return occupiedCount; }
+
+private:
+    CellDomain domain;
+    CellStencil stencil;
+    bool domainValid{false};
+    bool indexValid{false};
+
+    std::vector<uint32_t> cellStarts;
+    std::vector<uint32_t> cellEnds;
+    std::vector<uint32_t> occupiedCells;
+    size_t occupiedCount{0};
+    // first occupiedCells slot of every worker's block
+    std::vector<size_t> blockOffsets;
+};
+
+#endif // SPH_NEIGHBOR_GRID_H
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include "neighborList.h"
+
+void NeighborList::build(
+    ThreadPool &threadPool, const ParticleData &particles,
+    const NeighborGrid &grid, float radius)
+{
+    const size_t particleCount = particles.count;
+    const size_t threadCount = threadPool.size();
+    offsets.resize(particleCount + 1);
+    refX.resize(particleCount);
+    refY.resize(particleCount);
+    refZ.resize(particleCount);
+    blockNeighbors.resize(threadCount);
+    blockOffsets.resize(threadCount + 1);
+
+    const float *posX = particles.posX;
+    const float *posY = particles.posY;
+    const float *posZ = particles.posZ;
+    const uint32_t *cellStarts = grid.getCellStarts();
+    const uint32_t *cellEnds = grid.getCellEnds();
+    const CellDomain &domain = grid.getDomain();
+    const std::vector<glm::ivec3> &stencil = grid.getStencil().offsets;
+    const float radius2 = radius * radius;
+
+    // Search every block into its own list, offsets relative to the block
+    threadPool.run([&](size_t threadIndex, size_t threadCount) {
+        size_t start, end;
+        ThreadPool::blockRange(particleCount, threadIndex, threadCount, start, end);
+        std::vector<uint32_t> &local = blockNeighbors[threadIndex];
+        local.clear();
+
+        for (size_t piIndex = start; piIndex < end; piIndex++) {
+            offsets[piIndex] = uint32_t(local.size());
+            glm::vec3 pi(posX[piIndex], posY[piIndex], posZ[piIndex]);
+            refX[piIndex] = pi.x;
+            refY[piIndex] = pi.y;
+            refZ[piIndex] = pi.z;
+            glm::ivec3 cell = domain.getCell(pi);
+
+            for (const glm::ivec3 &offset : stencil) {
+                glm::ivec3 neighborCell = cell + offset;
+                if (!domain.contains(neighborCell)) {
+                    continue;
+                }
+                uint32_t cellKey = domain.getKey(neighborCell);
+                uint32_t pjEnd = cellEnds[cellKey];
+                for (uint32_t pjIndex = cellStarts[cellKey]; pjIndex < pjEnd; pjIndex++) {
+                    if (pjIndex == piIndex) {
+                        continue;
+                    }
+                    float dx = posX[pjIndex] - pi.x;
+                    float dy = posY[pjIndex] - pi.y;
+                    float dz = posZ[pjIndex] - pi.z;
+                    if (dx * dx + dy * dy + dz * dz < radius2) {
+                        local.push_back(pjIndex);
+                    }
+                }
+            }
+        }
+        blockOffsets[threadIndex + 1] = local.size();
+    });
+
+    blockOffsets[0] = 0;
+    for (size_t t = 0; t < threadCount; t++) {
+        blockOffsets[t + 1] += blockOffsets[t];
+    }
+    neighbors.resize(blockOffsets[threadCount]);
+    offsets[particleCount] = uint32_t(blockOffsets[threadCount]);
+
+    // Concatenate the block lists
+    threadPool.run([&](size_t threadIndex, size_t threadCount) {
+        size_t start, end;
+        ThreadPool::blockRange(particleCount, threadIndex, threadCount, start, end);
+        const std::vector<uint32_t> &local = blockNeighbors[threadIndex];
+        uint32_t base = uint32_t(blockOffsets[threadIndex]);
+        std::copy(local.begin(), local.end(), neighbors.begin() + base);
+        for (size_t i = start; i < end; i++) {
+            offsets[i] += base;
+        }
+    });
+
+    valid = true;
+}
+
+bool NeighborList::needsRebuild(
+    ThreadPool &threadPool, const ParticleData &particles, float skin) const
+{
+    if (!valid || offsets.size() != particles.count + 1) {
+        return true;
+    }
+
+    std::vector<float> maxDisplacement2(threadPool.size(), 0.0f);
+    threadPool.run([&](size_t threadIndex, size_t threadCount) {
+        size_t start, end;
+        ThreadPool::blockRange(particles.count, threadIndex, threadCount, start, end);
+        float localMax = 0.0f;
+        for (size_t i = start; i < end; i++) {
+            float dx = particles.posX[i] - refX[i];
+            float dy = particles.posY[i] - refY[i];
+            float dz = particles.posZ[i] - refZ[i];
+            localMax = std::max(localMax, dx * dx + dy * dy + dz * dz);
+        }
+        maxDisplacement2[threadIndex] = localMax;
+    });
+
+    float halfSkin = 0.5f * skin;
+    return *std::max_element(maxDisplacement2.begin(), maxDisplacement2.end())
+        > halfSkin * halfSkin;
+}
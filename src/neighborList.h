@@ -0,0 +1,51 @@
+#ifndef SPH_NEIGHBOR_LIST_H
+#define SPH_NEIGHBOR_LIST_H
+
+#include <cstdint>
+#include <vector>
+#include "threadPool.h"
+#include "sphParticles.h"
+#include "neighborGrid.h"
+
+/// \class NeighborList
+///
+/// Verlet neighbour lists: for every particle the indices of all particles
+/// within the support radius plus a skin, stored back to back. The lists
+/// stay valid until some particle moved more than half the skin since the
+/// build, so several steps can share one neighbour search. The particle
+/// order must not change while the lists are in use.
+class NeighborList
+{
+public:
+    /// Builds the lists in parallel from the grid of the sorted particles.
+    /// The grid's stencil must reach radius.
+    void build(
+        ThreadPool &threadPool, const ParticleData &particles,
+        const NeighborGrid &grid, float radius);
+
+    /// Marks the lists stale, e.g. after the particles were re-sorted.
+    void invalidate() { valid = false; }
+    bool isValid() const { return valid; }
+
+    /// True when some particle moved more than skin / 2 since the build.
+    bool needsRebuild(
+        ThreadPool &threadPool, const ParticleData &particles,
+        float skin) const;
+
+    /// Neighbours of particle i are getNeighbors()[getOffsets()[i], getOffsets()[i + 1]).
+    const uint32_t *getOffsets() const { return offsets.data(); }
+    const uint32_t *getNeighbors() const { return neighbors.data(); }
+    size_t getSize() const { return neighbors.size(); }
+
+private:
+    bool valid{false};
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> neighbors;
+    // positions at build time, for the displacement check
+    std::vector<float> refX, refY, refZ;
+    // lists of every worker's block before they are concatenated
+    std::vector<std::vector<uint32_t>> blockNeighbors;
+    std::vector<size_t> blockOffsets;
+};
+
+#endif // SPH_NEIGHBOR_LIST_H
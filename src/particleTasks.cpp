@@ -0,0 +1,68 @@
+#include <algorithm>
+#include "particleTasks.h"
+
+void ParticleTasks::build(ThreadPool &threadPool, const ParticleData &particles, bool balanced)
+{
+    const size_t particleCount = particles.count;
+    const size_t threadCount = threadPool.size();
+    taskStarts.clear();
+    taskStarts.push_back(0);
+    if (!balanced) {
+        for (size_t t = 0; t < threadCount; t++) {
+            size_t start, end;
+            ThreadPool::blockRange(particleCount, t, threadCount, start, end);
+            taskStarts.push_back(uint32_t(end));
+        }
+        return;
+    }
+
+    const size_t chunkCount = (particleCount + COST_CHUNK - 1) / COST_CHUNK;
+    chunkCosts.resize(chunkCount);
+    threadPool.parallelFor(chunkCount, [&](size_t start, size_t end) {
+        for (size_t chunk = start; chunk < end; chunk++) {
+            size_t first = chunk * COST_CHUNK;
+            size_t last = std::min(first + COST_CHUNK, particleCount);
+            uint64_t cost = last - first;
+            for (size_t i = first; i < last; i++) {
+                cost += particles.neighborCount[i];
+            }
+            chunkCosts[chunk] = cost;
+        }
+    });
+    for (size_t chunk = 1; chunk < chunkCount; chunk++) {
+        chunkCosts[chunk] += chunkCosts[chunk - 1];
+    }
+
+    // Cut where the prefix sum crosses every multiple of the task cost,
+    // then move the cut to the next cell, so no cell is split
+    const size_t taskCount = std::min(threadCount * TASKS_PER_THREAD, chunkCount);
+    const uint64_t totalCost = chunkCount > 0 ? chunkCosts.back() : 0;
+    for (size_t t = 1; t < taskCount; t++) {
+        uint64_t target = totalCost * t / taskCount;
+        size_t chunk = std::lower_bound(chunkCosts.begin(), chunkCosts.end(), target)
+            - chunkCosts.begin();
+        size_t cut = std::min((chunk + 1) * COST_CHUNK, particleCount);
+        cut = std::max(cut, size_t(taskStarts.back()));
+        while (cut > 0 && cut < particleCount
+               && particles.cellKey[cut] == particles.cellKey[cut - 1]) {
+            cut++;
+        }
+        if (cut > taskStarts.back() && cut < particleCount) {
+            taskStarts.push_back(uint32_t(cut));
+        }
+    }
+    taskStarts.push_back(uint32_t(particleCount));
+}
+
+void ParticleTasks::run(
+    ThreadPool &threadPool,
+    const std::function<void(size_t start, size_t end, size_t threadIndex)> &job) const
+{
+    threadPool.runTasks(getTaskCount(), [&](size_t task, size_t threadIndex) {
+        size_t start = taskStarts[task];
+        size_t end = taskStarts[task + 1];
+        if (start < end) {
+            job(start, end, threadIndex);
+        }
+    });
+}
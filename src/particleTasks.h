@@ -0,0 +1,50 @@
+#ifndef SPH_PARTICLE_TASKS_H
+#define SPH_PARTICLE_TASKS_H
+
+#include <cstdint>
+#include <vector>
+#include "threadPool.h"
+#include "sphParticles.h"
+
+/// \class ParticleTasks
+///
+/// Split of the sorted particles into tasks of whole grid cells with about
+/// the same estimated cost, for the per-particle passes of a step. A
+/// particle costs its neighbour count of the last density pass plus one,
+/// so the dense cells at the bottom of a pool get smaller tasks than the
+/// sparse ones of a splash. The workers run the tasks with
+/// ThreadPool::runTasks and steal from each other where the estimate was
+/// off.
+///
+/// All tables persist across calls.
+class ParticleTasks
+{
+public:
+    /// Tasks every worker gets on average; more balance better, fewer
+    /// cost less scheduling and fewer cells split between caches.
+    static const size_t TASKS_PER_THREAD = 8;
+    /// Particles per entry of the cost prefix sum, the granularity the
+    /// task ends are searched at before they move to the next cell.
+    static const size_t COST_CHUNK = 256;
+
+    /// Splits the particles by the cost of particles.neighborCount. With
+    /// balanced false, they are split like ThreadPool::parallelFor instead,
+    /// one equal block per worker.
+    void build(ThreadPool &threadPool, const ParticleData &particles, bool balanced);
+
+    /// Runs job(start, end, threadIndex) for every task's particle range.
+    void run(
+        ThreadPool &threadPool,
+        const std::function<void(size_t start, size_t end, size_t threadIndex)> &job) const;
+
+    size_t getTaskCount() const { return taskStarts.empty() ? 0 : taskStarts.size() - 1; }
+    /// First particle of every task and the particle count at the end.
+    const std::vector<uint32_t> &getTaskStarts() const { return taskStarts; }
+
+private:
+    // inclusive prefix sum of the chunk costs
+    std::vector<uint64_t> chunkCosts;
+    std::vector<uint32_t> taskStarts;
+};
+
+#endif // SPH_PARTICLE_TASKS_H
@@ -0,0 +1,210 @@
+#include "profiler.h"
+
+#ifdef SPH_PROFILE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <unordered_map>
+
+namespace {
+// Nesting depth of the open zones of the current thread
+thread_local uint32_t zoneDepth = 0;
+}
+
+/// Single-writer ring of the last EVENTS_PER_THREAD zones of one thread.
+/// The slots are relaxed atomics so the readers may copy them while the
+/// owner overwrites the oldest ones; head publishes every finished slot.
+struct Profiler::ThreadBuffer
+{
+    struct Slot
+    {
+        std::atomic<const char *> name{nullptr};
+        std::atomic<uint64_t> start{0};
+        std::atomic<uint64_t> end{0};
+        std::atomic<uint32_t> depth{0};
+    };
+
+    explicit ThreadBuffer(uint32_t threadId)
+        : threadId(threadId), slots(new Slot[EVENTS_PER_THREAD])
+    {
+    }
+
+    uint32_t threadId;
+    // Number of events ever written
+    std::atomic<uint64_t> head{0};
+    std::unique_ptr<Slot[]> slots;
+};
+
+Profiler &Profiler::get()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+uint64_t Profiler::now()
+{
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+Profiler::ThreadBuffer &Profiler::getThreadBuffer()
+{
+    thread_local ThreadBuffer *buffer = nullptr;
+    if (buffer == nullptr) {
+        // First zone of this thread; the buffer outlives the thread so its
+        // events stay in the trace
+        std::lock_guard<std::mutex> lock(mutex);
+        buffers.emplace_back(new ThreadBuffer(uint32_t(buffers.size())));
+        buffer = buffers.back().get();
+    }
+    return *buffer;
+}
+
+void Profiler::record(const char *name, uint64_t start, uint64_t end, uint32_t depth)
+{
+    ThreadBuffer &buffer = getThreadBuffer();
+    uint64_t index = buffer.head.load(std::memory_order_relaxed);
+    ThreadBuffer::Slot &slot = buffer.slots[index % EVENTS_PER_THREAD];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    slot.depth.store(depth, std::memory_order_relaxed);
+    buffer.head.store(index + 1, std::memory_order_release);
+}
+
+std::vector<ProfileEvent> Profiler::collectEvents() const
+{
+    std::vector<ProfileEvent> events;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const std::unique_ptr<ThreadBuffer> &buffer : buffers) {
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t first = head > EVENTS_PER_THREAD ? head - EVENTS_PER_THREAD : 0;
+        size_t copyStart = events.size();
+        for (uint64_t index = first; index < head; index++) {
+            const ThreadBuffer::Slot &slot = buffer->slots[index % EVENTS_PER_THREAD];
+            ProfileEvent event;
+            event.name = slot.name.load(std::memory_order_relaxed);
+            event.start = slot.start.load(std::memory_order_relaxed);
+            event.end = slot.end.load(std::memory_order_relaxed);
+            event.depth = slot.depth.load(std::memory_order_relaxed);
+            event.threadId = buffer->threadId;
+            events.push_back(event);
+        }
+
+        // The owner may have lapped the copy meanwhile; the slot of the
+        // event it is writing now is gone as well
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t newHead = buffer->head.load(std::memory_order_relaxed);
+        uint64_t valid = newHead >= EVENTS_PER_THREAD
+            ? newHead - EVENTS_PER_THREAD + 1 : 0;
+        if (valid > first) {
+            size_t stale = size_t(std::min(valid, head) - first);
+            events.erase(
+                events.begin() + copyStart,
+                events.begin() + copyStart + stale);
+        }
+    }
+
+    events.erase(
+        std::remove_if(events.begin(), events.end(),
+            [this](const ProfileEvent &event) {
+                return event.start < clearTime;
+            }),
+        events.end());
+    std::sort(events.begin(), events.end(),
+        [](const ProfileEvent &a, const ProfileEvent &b) {
+            return a.start < b.start;
+        });
+    return events;
+}
+
+std::vector<ProfileZoneStats> Profiler::collectStats() const
+{
+    std::vector<ProfileEvent> events = collectEvents();
+
+    // Group by name text, the same literal may have several addresses
+    std::vector<ProfileZoneStats> stats;
+    std::vector<std::vector<double>> durations;
+    std::unordered_map<std::string, size_t> zoneIndex;
+    for (const ProfileEvent &event : events) {
+        auto found = zoneIndex.find(event.name);
+        size_t zone;
+        if (found == zoneIndex.end()) {
+            zone = stats.size();
+            zoneIndex.emplace(event.name, zone);
+            stats.push_back({event.name, event.depth, 0, 0.0, 0.0, 0.0});
+            durations.emplace_back();
+        }
+        else {
+            zone = found->second;
+        }
+        stats[zone].depth = std::min(stats[zone].depth, event.depth);
+        durations[zone].push_back((event.end - event.start) * 1e-6);
+    }
+
+    for (size_t zone = 0; zone < stats.size(); zone++) {
+        std::vector<double> &times = durations[zone];
+        std::sort(times.begin(), times.end());
+        double sum = 0.0;
+        for (double time : times) {
+            sum += time;
+        }
+        size_t p99 = size_t(std::ceil(0.99 * double(times.size()))) - 1;
+        stats[zone].count = times.size();
+        stats[zone].minMs = times.front();
+        stats[zone].meanMs = sum / double(times.size());
+        stats[zone].p99Ms = times[p99];
+    }
+    return stats;
+}
+
+bool Profiler::exportChromeTrace(const std::string &path) const
+{
+    std::ofstream file(path);
+    if (!file) {
+        return false;
+    }
+
+    std::vector<ProfileEvent> events = collectEvents();
+    uint64_t origin = events.empty() ? 0 : events.front().start;
+
+    // Complete ("X") events in microseconds; zone names are literals from
+    // the source and need no escaping
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    file.precision(3);
+    file << std::fixed;
+    for (size_t i = 0; i < events.size(); i++) {
+        const ProfileEvent &event = events[i];
+        file << (i == 0 ? "\n" : ",\n")
+             << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1"
+             << ",\"tid\":" << event.threadId
+             << ",\"ts\":" << (event.start - origin) * 1e-3
+             << ",\"dur\":" << (event.end - event.start) * 1e-3 << "}";
+    }
+    file << "\n]}\n";
+    return bool(file);
+}
+
+void Profiler::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    clearTime = now();
+}
+
+ProfileZone::ProfileZone(const char *name)
+    : name(name), depth(zoneDepth++)
+{
+    start = Profiler::now();
+}
+
+ProfileZone::~ProfileZone()
+{
+    uint64_t end = Profiler::now();
+    zoneDepth--;
+    Profiler::get().record(name, start, end, depth);
+}
+
+#endif // SPH_PROFILE
@@ -0,0 +1,109 @@
+#ifndef SPH_PROFILER_H
+#define SPH_PROFILER_H
+
+/// Scoped profiler zones. SPH_PROFILE_ZONE("name") records the time from
+/// the macro to the end of the enclosing scope; the name must be a string
+/// literal. Without SPH_PROFILE defined (CMake option SPH_PROFILE) the
+/// macro expands to nothing and none of the profiler is compiled.
+
+#ifdef SPH_PROFILE
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// One finished zone of one thread, times in nanoseconds of Profiler::now.
+struct ProfileEvent
+{
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+    uint32_t depth;
+    uint32_t threadId;
+};
+
+/// Durations of all retained events of one zone name, in milliseconds.
+struct ProfileZoneStats
+{
+    std::string name;
+    uint32_t depth;
+    uint64_t count;
+    double minMs;
+    double meanMs;
+    double p99Ms;
+};
+
+/// \class Profiler
+///
+/// Collects the zones of every thread. Each thread writes into its own
+/// ring buffer of the last EVENTS_PER_THREAD zones without any locking;
+/// the readers copy the rings and drop the entries that were overwritten
+/// while they read, so statistics and traces can be taken while the
+/// simulation runs.
+class Profiler
+{
+public:
+    static const size_t EVENTS_PER_THREAD = 1 << 14;
+
+    static Profiler &get();
+    /// Monotonic time in nanoseconds.
+    static uint64_t now();
+
+    /// Appends a finished zone to the calling thread's ring.
+    void record(const char *name, uint64_t start, uint64_t end, uint32_t depth);
+
+    /// Retained events of every thread started after the last clear(),
+    /// ordered by start time.
+    std::vector<ProfileEvent> collectEvents() const;
+    /// min/mean/p99 per zone name, in the order the zones first appear.
+    std::vector<ProfileZoneStats> collectStats() const;
+    /// Writes the retained events as Chrome trace-event JSON, viewable in
+    /// chrome://tracing or Perfetto. Returns false if the file can't be
+    /// written.
+    bool exportChromeTrace(const std::string &path) const;
+    /// Hides all events recorded so far.
+    void clear();
+
+private:
+    struct ThreadBuffer;
+
+    Profiler() = default;
+    ThreadBuffer &getThreadBuffer();
+
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    uint64_t clearTime{0};
+};
+
+/// \class ProfileZone
+///
+/// RAII zone behind SPH_PROFILE_ZONE.
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char *name);
+    ~ProfileZone();
+
+    ProfileZone(const ProfileZone &) = delete;
+    ProfileZone &operator=(const ProfileZone &) = delete;
+
+private:
+    const char *name;
+    uint64_t start;
+    uint32_t depth;
+};
+
+#define SPH_PROFILE_CONCAT_(a, b) a##b
+#define SPH_PROFILE_CONCAT(a, b) SPH_PROFILE_CONCAT_(a, b)
+#define SPH_PROFILE_ZONE(name) \
+    ProfileZone SPH_PROFILE_CONCAT(profileZone, __LINE__)(name)
+
+#else
+
+#define SPH_PROFILE_ZONE(name) ((void)0)
+
+#endif // SPH_PROFILE
+
+#endif // SPH_PROFILER_H
@@ -0,0 +1,205 @@
+#include <algorithm>
+#include "radixSort.h"
+
+namespace {
+// Widest digit per pass; 2^11 counters per thread still fit in L1.
+const uint32_t MAX_RADIX_BITS = 11;
+}
+
+const uint32_t *RadixSorter::sort(
+    ThreadPool &threadPool, const uint32_t *keys, size_t count,
+    uint32_t maxKey)
+{
+    resortStreak = 0;
+    return sortKeys(threadPool, keys, count, maxKey);
+}
+
+const uint32_t *RadixSorter::sortKeys(
+    ThreadPool &threadPool, const uint32_t *keys, size_t count,
+    uint32_t maxKey)
+{
+    for (int i = 0; i < 2; i++) {
+        if (keyBuffers[i].size() < count) {
+            keyBuffers[i].resize(count);
+            orderBuffers[i].resize(count);
+        }
+    }
+
+    // Split the significant bits evenly over the fewest passes
+    uint32_t keyBits = 1;
+    while (keyBits < 32 && (maxKey >> keyBits) != 0) {
+        keyBits++;
+    }
+    const uint32_t passCount = (keyBits + MAX_RADIX_BITS - 1) / MAX_RADIX_BITS;
+    const uint32_t radixBits = (keyBits + passCount - 1) / passCount;
+    const size_t bucketCount = size_t(1) << radixBits;
+    const uint32_t digitMask = uint32_t(bucketCount - 1);
+    const size_t threadCount = threadPool.size();
+    histogram.resize(threadCount * bucketCount);
+
+    const uint32_t *inKeys = nullptr;
+    const uint32_t *inOrder = nullptr;
+    for (uint32_t pass = 0; pass < passCount; pass++) {
+        const uint32_t shift = pass * radixBits;
+        const bool firstPass = pass == 0;
+        const bool lastPass = pass + 1 == passCount;
+        uint32_t *outKeys = keyBuffers[pass & 1].data();
+        uint32_t *outOrder = orderBuffers[pass & 1].data();
+
+        // Count digits of every thread's block
+        threadPool.run([&](size_t threadIndex, size_t threadCount) {
+            size_t start, end;
+            ThreadPool::blockRange(count, threadIndex, threadCount, start, end);
+            uint32_t *counts = &histogram[threadIndex * bucketCount];
+            std::fill(counts, counts + bucketCount, 0);
+            for (size_t i = start; i < end; i++) {
+                uint32_t key = firstPass ? keys[i] : inKeys[i];
+                counts[(key >> shift) & digitMask]++;
+            }
+        });
+
+        // Exclusive scan, digit-major so equal digits keep thread order
+        uint32_t offset = 0;
+        for (size_t digit = 0; digit < bucketCount; digit++) {
+            for (size_t t = 0; t < threadCount; t++) {
+                uint32_t digitCount = histogram[t * bucketCount + digit];
+                histogram[t * bucketCount + digit] = offset;
+                offset += digitCount;
+            }
+        }
+
+        // Stable scatter of keys and indices
+        threadPool.run([&](size_t threadIndex, size_t threadCount) {
+            size_t start, end;
+            ThreadPool::blockRange(count, threadIndex, threadCount, start, end);
+            uint32_t *offsets = &histogram[threadIndex * bucketCount];
+            for (size_t i = start; i < end; i++) {
+                uint32_t key = firstPass ? keys[i] : inKeys[i];
+                uint32_t dst = offsets[(key >> shift) & digitMask]++;
+                outOrder[dst] = firstPass ? uint32_t(i) : inOrder[i];
+                if (!lastPass) {
+                    outKeys[dst] = key;
+                }
+            }
+        });
+
+        inKeys = outKeys;
+        inOrder = outOrder;
+    }
+    return inOrder;
+}
+
+const uint32_t *RadixSorter::resort(
+    ThreadPool &threadPool, const uint32_t *keys, size_t count,
+    uint32_t maxKey, const NeighborGrid &grid, size_t maxMovers)
+{
+    const uint32_t *cellStarts = grid.getCellStarts();
+    const uint32_t *cellEnds = grid.getCellEnds();
+    const uint32_t *occupiedCells = grid.getOccupiedCells();
+    const size_t occupiedCount = grid.getOccupiedCount();
+    const size_t threadCount = threadPool.size();
+    moverCount = 0;
+    // The index must cover exactly these keys
+    if (count == 0 || occupiedCount == 0
+        || cellEnds[occupiedCells[occupiedCount - 1]] != count) {
+        return nullptr;
+    }
+
+    // Every worker walks the cells of the index along its block; a key
+    // differing from its cell's key moved
+    auto forEachKey = [&](size_t start, size_t end, auto &&visit) {
+        size_t run = std::upper_bound(occupiedCells, occupiedCells + occupiedCount,
+            uint32_t(start), [&](uint32_t index, uint32_t cellKey) {
+                return index < cellStarts[cellKey];
+            }) - occupiedCells - 1;
+        for (size_t i = start; i < end; i++) {
+            while (cellEnds[occupiedCells[run]] <= i) {
+                run++;
+            }
+            visit(i, keys[i] != occupiedCells[run]);
+        }
+    };
+
+    blockMovers.assign(threadCount + 1, 0);
+    threadPool.run([&](size_t threadIndex, size_t threadCount) {
+        size_t start, end;
+        ThreadPool::blockRange(count, threadIndex, threadCount, start, end);
+        size_t moved = 0;
+        forEachKey(start, end, [&](size_t, bool isMover) {
+            moved += isMover;
+        });
+        blockMovers[threadIndex + 1] = moved;
+    });
+    for (size_t t = 0; t < threadCount; t++) {
+        blockMovers[t + 1] += blockMovers[t];
+    }
+    moverCount = blockMovers[threadCount];
+    if (moverCount > maxMovers) {
+        return nullptr;
+    }
+
+    const size_t stayerCount = count - moverCount;
+    movers.resize(moverCount);
+    moverKeys.resize(moverCount);
+    stayers.resize(stayerCount);
+    mergedOrder.resize(count);
+    threadPool.run([&](size_t threadIndex, size_t threadCount) {
+        size_t start, end;
+        ThreadPool::blockRange(count, threadIndex, threadCount, start, end);
+        size_t moverSlot = blockMovers[threadIndex];
+        size_t stayerSlot = start - moverSlot;
+        forEachKey(start, end, [&](size_t i, bool isMover) {
+            if (isMover) {
+                movers[moverSlot] = uint32_t(i);
+                moverKeys[moverSlot++] = keys[i];
+            }
+            else {
+                stayers[stayerSlot++] = uint32_t(i);
+            }
+        });
+    });
+
+    // The stayers are still in key order. A stable sort of the movers
+    // keeps equal keys in index order, so both sequences are ordered by
+    // (key, index) and merge into exactly what sort() returns.
+    const uint32_t *moverOrder = moverCount > 0
+        ? sortKeys(threadPool, moverKeys.data(), moverCount, maxKey) : nullptr;
+    auto stayerAt = [&](size_t s) {
+        uint32_t index = stayers[s];
+        return uint64_t(keys[index]) << 32 | index;
+    };
+    auto moverAt = [&](size_t m) {
+        uint32_t index = movers[moverOrder[m]];
+        return uint64_t(keys[index]) << 32 | index;
+    };
+
+    // Merge path: every worker finds how many stayers precede its block
+    // of the output by binary search, then merges the block on its own
+    threadPool.run([&](size_t threadIndex, size_t threadCount) {
+        size_t start, end;
+        ThreadPool::blockRange(count, threadIndex, threadCount, start, end);
+        size_t low = start > moverCount ? start - moverCount : 0;
+        size_t high = std::min(start, stayerCount);
+        while (low < high) {
+            size_t taken = (low + high) / 2;
+            if (stayerAt(taken) < moverAt(start - taken - 1)) {
+                low = taken + 1;
+            }
+            else {
+                high = taken;
+            }
+        }
+        size_t s = low;
+        size_t m = start - low;
+        for (size_t out = start; out < end; out++) {
+            if (m == moverCount || (s < stayerCount && stayerAt(s) < moverAt(m))) {
+                mergedOrder[out] = stayers[s++];
+            }
+            else {
+                mergedOrder[out] = movers[moverOrder[m++]];
+            }
+        }
+    });
+    resortStreak++;
+    return mergedOrder.data();
+}
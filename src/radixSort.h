@@ -0,0 +1,62 @@
+#ifndef SPH_RADIX_SORT_H
+#define SPH_RADIX_SORT_H
+
+#include <cstdint>
+#include <vector>
+#include "threadPool.h"
+#include "neighborGrid.h"
+
+/// \class RadixSorter
+///
+/// Parallel LSD radix sort over bounded integer keys. Only the keys and an
+/// index permutation are moved; the caller gathers its payload once with
+/// the returned order. Scratch buffers are kept between calls.
+///
+/// Keys that were sorted before and mostly kept their value can be
+/// re-sorted incrementally instead: only the changed ones are sorted and
+/// merged back into the rest, which stayed in order.
+class RadixSorter
+{
+public:
+    /// Stable sort of keys[0, count), all of which must be <= maxKey.
+    /// Returns the permutation: element i of the sorted sequence is
+    /// keys[order[i]]. The pointer stays valid until the next call.
+    const uint32_t *sort(
+        ThreadPool &threadPool, const uint32_t *keys, size_t count,
+        uint32_t maxKey);
+
+    /// Same order as sort(), for keys whose previous values grid was
+    /// built from, i.e. grid.hasIndex() for the current order. The keys
+    /// that left their cell since, the movers, are radix sorted on their
+    /// own and merged with the others in parallel. Returns nullptr without
+    /// sorting if more than maxMovers moved.
+    const uint32_t *resort(
+        ThreadPool &threadPool, const uint32_t *keys, size_t count,
+        uint32_t maxKey, const NeighborGrid &grid, size_t maxMovers);
+    /// Movers found by the last resort().
+    size_t getMoverCount() const { return moverCount; }
+    /// Successful resort() calls since the last sort().
+    size_t getResortStreak() const { return resortStreak; }
+
+private:
+    const uint32_t *sortKeys(
+        ThreadPool &threadPool, const uint32_t *keys, size_t count,
+        uint32_t maxKey);
+
+    std::vector<uint32_t> keyBuffers[2];
+    std::vector<uint32_t> orderBuffers[2];
+    // per thread digit counts, turned into scatter offsets in place
+    std::vector<uint32_t> histogram;
+
+    // resort(): movers and stayers in index order, the movers' keys and
+    // the merged permutation
+    std::vector<size_t> blockMovers;
+    std::vector<uint32_t> movers;
+    std::vector<uint32_t> moverKeys;
+    std::vector<uint32_t> stayers;
+    std::vector<uint32_t> mergedOrder;
+    size_t moverCount{0};
+    size_t resortStreak{0};
+};
+
+#endif // SPH_RADIX_SORT_H
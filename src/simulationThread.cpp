@@ -0,0 +1,133 @@
+#include "simulationThread.h"
+#include "profiler.h"
+
+SimulationThread::SimulationThread(
+    size_t particleCubeWidth, const SPHSettings &settings, bool runOnGPU,
+    size_t threadCount, ParticleInstance *instanceRegions):
+    simulation(particleCubeWidth, settings, runOnGPU, threadCount),
+    particleCount(simulation.getParticleCount()),
+    pendingSettings(settings)
+{
+    if (instanceRegions == nullptr) {
+        ownedInstances.resize(SNAPSHOT_COUNT * particleCount);
+        instanceRegions = ownedInstances.data();
+    }
+    for (size_t region = 0; region < SNAPSHOT_COUNT; region++) {
+        SimulationSnapshot &snapshot = snapshots.getBuffers()[region];
+        snapshot.instances = instanceRegions + region * particleCount;
+        snapshot.region = region;
+    }
+
+    // The renderer has the initial particles before the first step
+    publishSnapshot();
+    thread = std::thread(&SimulationThread::run, this);
+}
+
+SimulationThread::~SimulationThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        requestPending = true;
+    }
+    wakeCondition.notify_one();
+    thread.join();
+}
+
+void SimulationThread::setRunning(bool running)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->running = running;
+        requestPending = true;
+    }
+    wakeCondition.notify_one();
+}
+
+void SimulationThread::setSettings(const SPHSettings &settings, float deltaTime)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pendingSettings = settings;
+        pendingTimeStep = deltaTime;
+        settingsChanged = true;
+        requestPending = true;
+    }
+    wakeCondition.notify_one();
+}
+
+void SimulationThread::reset()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        resetRequested = true;
+        running = false;
+        requestPending = true;
+    }
+    wakeCondition.notify_one();
+}
+
+const SimulationSnapshot &SimulationThread::acquireSnapshot()
+{
+    snapshots.update();
+    return snapshots.getFront();
+}
+
+void SimulationThread::run()
+{
+    float deltaTime = 0.0f;
+    bool isRunning = false;
+    while (true) {
+        bool snapshotNeeded = false;
+        if (!isRunning || requestPending.load(std::memory_order_acquire)) {
+            // Paused threads sleep here until the render thread asks for
+            // something
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeCondition.wait(lock, [this] {
+                return running || requestPending.load(std::memory_order_relaxed);
+            });
+            requestPending = false;
+            if (stopping) {
+                return;
+            }
+            if (settingsChanged) {
+                simulation.getSettings() = pendingSettings;
+                settingsChanged = false;
+            }
+            deltaTime = pendingTimeStep;
+            if (resetRequested) {
+                simulation.reset();
+                resetRequested = false;
+                snapshotNeeded = true;
+            }
+            isRunning = running;
+        }
+
+        if (isRunning) {
+            float frameBudget = simulation.getSettings().frameBudget;
+            if (frameBudget > 0.0f) {
+                simulation.stepFor(frameBudget, deltaTime);
+            }
+            else {
+                simulation.step(deltaTime);
+            }
+            // Skip the snapshot while the last one is still unread
+            snapshotNeeded = snapshotNeeded || snapshots.isTaken();
+        }
+        if (snapshotNeeded) {
+            publishSnapshot();
+        }
+    }
+}
+
+void SimulationThread::publishSnapshot()
+{
+    SPH_PROFILE_ZONE("snapshot");
+    SimulationSnapshot &snapshot = snapshots.getBack();
+    snapshot.valueRange = simulation.writeInstances(snapshot.instances);
+    snapshot.neighborStats = simulation.getNeighborStats();
+    snapshot.threadIdleTimes = simulation.getThreadIdleTimes();
+    snapshot.timeStep = simulation.getLastTimeStep();
+    snapshot.stepCount = simulation.getStepCount();
+    snapshots.publish();
+}
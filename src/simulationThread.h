@@ -0,0 +1,94 @@
+#ifndef SPH_SIMULATION_THREAD_H
+#define SPH_SIMULATION_THREAD_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+#include "sphSimulation.h"
+#include "tripleBuffer.h"
+
+/// State of the simulation the renderer draws, as of one finished step.
+struct SimulationSnapshot
+{
+    // particle count instances, in region `region` of the instance storage
+    ParticleInstance *instances{nullptr};
+    size_t region{0};
+    // [min, max] of the instance values
+    glm::vec2 valueRange{0.0f};
+    NeighborStats neighborStats;
+    // seconds every worker idled in the last step
+    std::vector<double> threadIdleTimes;
+    float timeStep{0.0f};
+    uint64_t stepCount{0};
+};
+
+/// \class SimulationThread
+///
+/// Runs a SphSimulation on its own thread, so the solver advances at its
+/// own rate instead of once per rendered frame, and hands snapshots to
+/// the render thread through a triple buffer. A new snapshot is only
+/// built once the renderer took the previous one.
+///
+/// Settings, the fixed time step and reset requests are handed over under
+/// a mutex and applied between two steps; the snapshots need no lock.
+///
+/// The instances of the snapshots are written straight into caller storage
+/// of SNAPSHOT_COUNT consecutive regions of particle count instances, e.g.
+/// a persistently mapped GL buffer, or into owned memory without one.
+class SimulationThread
+{
+public:
+    static const size_t SNAPSHOT_COUNT = 3;
+
+    SimulationThread(
+        size_t particleCubeWidth, const SPHSettings &settings,
+        bool runOnGPU = false,
+        size_t threadCount = std::thread::hardware_concurrency(),
+        ParticleInstance *instanceRegions = nullptr);
+    ~SimulationThread();
+
+    SimulationThread(const SimulationThread &) = delete;
+    SimulationThread &operator=(const SimulationThread &) = delete;
+
+    /// Starts or pauses stepping.
+    void setRunning(bool running);
+    /// Settings and fixed time step of the following steps.
+    void setSettings(const SPHSettings &settings, float deltaTime);
+    /// Places the particles back on the initial cube and pauses.
+    void reset();
+
+    /// Render thread: the latest snapshot, never blocks. It stays valid
+    /// and unchanged until the next call.
+    const SimulationSnapshot &acquireSnapshot();
+
+    size_t getParticleCount() const { return particleCount; }
+
+private:
+    void run();
+    void publishSnapshot();
+
+    SphSimulation simulation;
+    size_t particleCount;
+    TripleBuffer<SimulationSnapshot> snapshots;
+    // instance regions when the caller has no storage
+    std::vector<ParticleInstance> ownedInstances;
+
+    // requests of the render thread, guarded by mutex
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    SPHSettings pendingSettings;
+    float pendingTimeStep{0.003f};
+    bool settingsChanged{false};
+    bool resetRequested{false};
+    bool running{false};
+    bool stopping{false};
+    // set with any request, so a step only takes the lock when needed
+    std::atomic<bool> requestPending{false};
+
+    std::thread thread;
+};
+
+#endif // SPH_SIMULATION_THREAD_H
@@ -1,313 +1,1020 @@
 #include <algorithm>
-#include <numeric>
-#include <mutex>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <vector>
 
 #include "sphCalculation.h"
 
-//----------------table util------------------------//
-uint32_t getHash(const glm::ivec3 &cell)
+//----------------cell domain------------------------//
+void fitCellDomain(
+    ThreadPool &threadPool, const ParticleData &particles, NeighborGrid &grid,
+    float cellSize, CellOrder order, int cellsPerRadius)
 {
-    return (
-        (uint32_t)(cell.x * 73856093)
-        ^ (uint32_t)(cell.y * 19349663)
-        ^ (uint32_t)(cell.z * 83492791)
-    ) % TABLE_SIZE;
-}
+    const size_t threadCount = threadPool.size();
+    std::vector<glm::vec3> lower(threadCount, glm::vec3(FLT_MAX));
+    std::vector<glm::vec3> upper(threadCount, glm::vec3(-FLT_MAX));
+
+    threadPool.run([&](size_t threadIndex, size_t threadCount) {
+        size_t start, end;
+        ThreadPool::blockRange(particles.count, threadIndex, threadCount, start, end);
+        for (size_t i = start; i < end; i++) {
+            glm::vec3 position(particles.posX[i], particles.posY[i], particles.posZ[i]);
+            lower[threadIndex] = glm::min(lower[threadIndex], position);
+            upper[threadIndex] = glm::max(upper[threadIndex], position);
+        }
+    });
 
-glm::ivec3 getCell(Particle *p, float h)
-{
-    return {p->position.x / h, p->position.y / h, p->position.z / h};
+    for (size_t t = 1; t < threadCount; t++) {
+        lower[0] = glm::min(lower[0], lower[t]);
+        upper[0] = glm::max(upper[0], upper[t]);
+    }
+    grid.setDomain(lower[0], upper[0], cellSize, order, cellsPerRadius);
 }
 
-uint32_t* createNeighborTable(
-    Particle *sortedParticles, const size_t &particleCount)
-{
-    uint32_t *particleTable
-        = (uint32_t *)malloc(sizeof(uint32_t) * TABLE_SIZE);
-    for (size_t i = 0; i < TABLE_SIZE; ++i) {
-        particleTable[i] = NO_PARTICLE;
-    }
+//-------------------------------------------------//
 
-    uint32_t prevHash = NO_PARTICLE;
-    for (size_t i = 0; i < particleCount; ++i) {
-        uint32_t currentHash = sortedParticles[i].hash;
-        if (currentHash != prevHash) {
-            particleTable[currentHash] = i;
-            prevHash = currentHash;
-        }
+// Calculates and stores the cell key of every particle.
+void parallelCalculateCellKeys(ParticleData &particles, size_t start, size_t end, const CellDomain &domain){
+    for (size_t i = start; i < end; i++) {
+        glm::vec3 position(particles.posX[i], particles.posY[i], particles.posZ[i]);
+        particles.cellKey[i] = domain.getKey(domain.getCell(position));
     }
-    return particleTable;
 }
+/// Pressure and viscosity force particle j exerts on particle i, for a
+/// pair closer than h. offset and velocityDif point from i to j.
+static inline glm::vec3 pairForce(
+    const glm::vec3 &offset, float dist2, const glm::vec3 &velocityDif,
+    float piPressure, float pjPressure, float pjDensity,
+    const SPHSettings &settings)
+{
+	//unit direction and length
+	float dist = sqrt(dist2);
+	glm::vec3 dir = glm::normalize(offset);
 
+	//apply pressure force
+	glm::vec3 pressureForce = -dir * settings.mass * (piPressure + pjPressure) / (2 * pjDensity) * settings.spikyGrad;
+	pressureForce *= std::pow(settings.h - dist, 2);
 
-//-------------------------------------------------//
+	//apply viscosity force
+	glm::vec3 viscoForce = settings.viscosity * settings.mass * (velocityDif / pjDensity) * settings.spikyLap * (settings.h - dist);
+	return pressureForce + viscoForce;
+}
 
-// Calculates and stores particle hashes.
-void parallelCalculateHashes(Particle *particles, size_t start, size_t end, const SPHSettings &settings){
-    for (size_t i = start; i < end; i++) {
-        Particle *particle = &particles[i];
-        particle->hash = getHash(getCell(particle, settings.h));
-    }
+/// Contribution of particle j to the continuity equation of particle i,
+/// m (vi - vj) . grad Wij, for a pair closer than h. The gradient is the
+/// one of the poly6 kernel the densities are summed with, so the rate is
+/// exactly how fast the summed density changes. The same for both
+/// particles of the pair.
+static inline float pairDensityRate(
+    const glm::vec3 &offset, float dist2, const glm::vec3 &velocityDif,
+    const SPHSettings &settings)
+{
+	float t = settings.h2 - dist2;
+	return -6.0f * settings.massPoly6Product * t * t * glm::dot(velocityDif, offset);
 }
+
 /// Parallel computation function for calculating density
 /// and pressures of particles in the given SPH System.
+/// Only positions are streamed for the neighbours.
+/// Adds the candidate pairs tested and the neighbours found to stats.
 void parallelDensityAndPressures(
-    Particle *particles, const size_t particleCount, const size_t start,
-    const size_t end, const uint32_t *particleTable,
-    const SPHSettings &settings)
+    ParticleData &particles, const size_t start, const size_t end,
+    const NeighborGrid &grid, const SPHSettings &settings,
+    NeighborStats &stats)
 {
+	const float *posX = particles.posX;
+	const float *posY = particles.posY;
+	const float *posZ = particles.posZ;
+	const uint32_t *cellStarts = grid.getCellStarts();
+	const uint32_t *cellEnds = grid.getCellEnds();
+	const CellDomain &domain = grid.getDomain();
+	const std::vector<glm::ivec3> &stencil = grid.getStencil().offsets;
 	float massPoly6Product = settings.mass * settings.poly6;
+	uint64_t candidatePairs = 0;
+	uint64_t neighborPairs = 0;
 
 	for (size_t piIndex = start; piIndex < end; piIndex++) {
 		float pDensity = 0;
-		Particle* pi = &particles[piIndex];
-		glm::ivec3 cell = getCell(pi, settings.h);
-
-		for (int x = -1; x <= 1; x++) {
-			for (int y = -1; y <= 1; y++) {
-				for (int z = -1; z <= 1; z++) {
-					uint16_t cellHash = getHash(cell + glm::ivec3(x, y, z));
-                    uint32_t pjIndex = particleTable[cellHash];
-                    if (pjIndex == NO_PARTICLE) {
-                        continue;
-                    }
-					while (pjIndex < particleCount) {
-                        if (pjIndex == piIndex) {
-                            pjIndex++;
-                            continue;
-                        }
-                        Particle *pj = &particles[pjIndex];
-                        if (pj->hash != cellHash) {
-                            break;
-                        }
-						float dist2 = glm::length2(pj->position - pi->position);
-						if (dist2 < settings.h2) {
-							pDensity += massPoly6Product
-                                * glm::pow(settings.h2 - dist2, 3);
-						}
-                        pjIndex++;
-					}
+		uint32_t neighbors = 0;
+		glm::vec3 pi(posX[piIndex], posY[piIndex], posZ[piIndex]);
+		glm::ivec3 cell = domain.getCell(pi);
+
+		for (const glm::ivec3 &offset : stencil) {
+			glm::ivec3 neighborCell = cell + offset;
+			if (!domain.contains(neighborCell)) {
+				continue;
+			}
+			uint32_t cellKey = domain.getKey(neighborCell);
+			uint32_t pjEnd = cellEnds[cellKey];
+			for (uint32_t pjIndex = cellStarts[cellKey]; pjIndex < pjEnd; pjIndex++) {
+				if (pjIndex == piIndex) {
+					continue;
+				}
+				float dx = posX[pjIndex] - pi.x;
+				float dy = posY[pjIndex] - pi.y;
+				float dz = posZ[pjIndex] - pi.z;
+				float dist2 = dx * dx + dy * dy + dz * dz;
+				candidatePairs++;
+				if (dist2 < settings.h2) {
+					neighbors++;
+					pDensity += massPoly6Product
+                        * glm::pow(settings.h2 - dist2, 3);
 				}
 			}
 		}
 
 		// Include self density (as itself isn't included in neighbour)
-		pi->density = pDensity + settings.selfDens;
+		float density = pDensity + settings.selfDens;
+		particles.density[piIndex] = density;
+		particles.neighborCount[piIndex] = neighbors;
+		neighborPairs += neighbors;
 
 		// Calculate pressure
-		float pPressure
-            = settings.gasConstant * (pi->density - settings.restDensity);
-		pi->pressure = pPressure;
+		particles.pressure[piIndex]
+            = settings.gasConstant * (density - settings.restDensity);
 	}
+
+	stats.candidatePairs += candidatePairs;
+	stats.neighborPairs += neighborPairs;
 }
 
 /// Parallel computation function for calculating forces
 /// of particles in the given SPH System.
+/// Reads position, velocity, pressure and density of the neighbours, and
+/// sums the density rate with settings.continuityDensity.
 void parallelForces(
-    Particle *particles, const size_t particleCount, const size_t start,
-    const size_t end, const uint32_t *particleTable,
-    const SPHSettings &settings)
+    ParticleData &particles, const size_t start, const size_t end,
+    const NeighborGrid &grid, const SPHSettings &settings)
 {
+	const float *posX = particles.posX;
+	const float *posY = particles.posY;
+	const float *posZ = particles.posZ;
+	const float *velX = particles.velX;
+	const float *velY = particles.velY;
+	const float *velZ = particles.velZ;
+	const float *pressure = particles.pressure;
+	const float *density = particles.density;
+	const uint32_t *cellStarts = grid.getCellStarts();
+	const uint32_t *cellEnds = grid.getCellEnds();
+	const CellDomain &domain = grid.getDomain();
+	const std::vector<glm::ivec3> &stencil = grid.getStencil().offsets;
+	const bool continuity = settings.continuityDensity;
+
 	for (size_t piIndex = start; piIndex < end; piIndex++) {
-		Particle* pi = &particles[piIndex];
-		pi->force = glm::vec3(0);
-		glm::ivec3 cell = getCell(pi, settings.h);
-
-		for (int x = -1; x <= 1; x++) {
-			for (int y = -1; y <= 1; y++) {
-				for (int z = -1; z <= 1; z++) {
-                    uint16_t cellHash = getHash(cell + glm::ivec3(x, y, z));
-                    uint32_t pjIndex = particleTable[cellHash];
-                    if (pjIndex == NO_PARTICLE) {
-                        continue;
-                    }
-                    while (pjIndex < particleCount) {
-                        if (pjIndex == piIndex) {
-                            pjIndex++;
-                            continue;
-                        }
-                        Particle *pj = &particles[pjIndex];
-                        if (pj->hash != cellHash) {
-                            break;
-                        }
-						float dist2 = glm::length2(pj->position - pi->position);
-						if (dist2 < settings.h2) {
-							//unit direction and length
-							float dist = sqrt(dist2);
-							glm::vec3 dir = glm::normalize(pj->position - pi->position);
-
-							//apply pressure force
-							glm::vec3 pressureForce = -dir * settings.mass * (pi->pressure + pj->pressure) / (2 * pj->density) * settings.spikyGrad;
-							pressureForce *= std::pow(settings.h - dist, 2);
-							pi->force += pressureForce;
-
-							//apply viscosity force
-							glm::vec3 velocityDif = pj->velocity - pi->velocity;
-							glm::vec3 viscoForce = settings.viscosity * settings.mass * (velocityDif / pj->density) * settings.spikyLap * (settings.h - dist);
-							pi->force += viscoForce;
-						}
-                        pjIndex++;
+		glm::vec3 pi(posX[piIndex], posY[piIndex], posZ[piIndex]);
+		glm::vec3 vi(velX[piIndex], velY[piIndex], velZ[piIndex]);
+		float piPressure = pressure[piIndex];
+		glm::vec3 force(0);
+		float densityRate = 0;
+		glm::ivec3 cell = domain.getCell(pi);
+
+		for (const glm::ivec3 &offset : stencil) {
+			glm::ivec3 neighborCell = cell + offset;
+			if (!domain.contains(neighborCell)) {
+				continue;
+			}
+			uint32_t cellKey = domain.getKey(neighborCell);
+			uint32_t pjEnd = cellEnds[cellKey];
+			for (uint32_t pjIndex = cellStarts[cellKey]; pjIndex < pjEnd; pjIndex++) {
+				if (pjIndex == piIndex) {
+					continue;
+				}
+				glm::vec3 pj(posX[pjIndex], posY[pjIndex], posZ[pjIndex]);
+				float dist2 = glm::length2(pj - pi);
+				if (dist2 < settings.h2) {
+					glm::vec3 vj(velX[pjIndex], velY[pjIndex], velZ[pjIndex]);
+					force += pairForce(
+                        pj - pi, dist2, vj - vi, piPressure,
+                        pressure[pjIndex], density[pjIndex], settings);
+					if (continuity) {
+						densityRate += pairDensityRate(pj - pi, dist2, vj - vi, settings);
 					}
 				}
 			}
 		}
+
+		particles.forceX[piIndex] = force.x;
+		particles.forceY[piIndex] = force.y;
+		particles.forceZ[piIndex] = force.z;
+		if (continuity) {
+			particles.densityRate[piIndex] = densityRate;
+		}
 	}
 }
 
+/// Candidate runs of the stencil cells around a cell, returns the run
+/// count. Stencil cells that are adjacent in memory merge into one run,
+/// e.g. the cells of every x row in the linear cell order.
+static int gatherCellRuns(
+    const NeighborGrid &grid, const glm::ivec3 &cell, ParticleRun *runs)
+{
+    const CellDomain &domain = grid.getDomain();
+    const uint32_t *cellStarts = grid.getCellStarts();
+    const uint32_t *cellEnds = grid.getCellEnds();
+    int runCount = 0;
+    for (const glm::ivec3 &offset : grid.getStencil().offsets) {
+        glm::ivec3 neighborCell = cell + offset;
+        if (!domain.contains(neighborCell)) {
+            continue;
+        }
+        uint32_t cellKey = domain.getKey(neighborCell);
+        uint32_t runStart = cellStarts[cellKey];
+        uint32_t runEnd = cellEnds[cellKey];
+        if (runStart == runEnd) {
+            continue;
+        }
+        if (runCount > 0 && runs[runCount - 1].end == runStart) {
+            runs[runCount - 1].end = runEnd;
+        }
+        else {
+            runs[runCount++] = ParticleRun{runStart, runEnd};
+        }
+    }
+    return runCount;
+}
+
+/// Runs the given SIMD kernel on the particles of [start, end) one cell at
+/// a time, so all particles of a cell share the candidate runs.
+template <class CellKernel>
+static void forEachCellRange(
+    const ParticleData &particles, const size_t start, const size_t end,
+    const NeighborGrid &grid, const CellKernel &kernel)
+{
+    const CellDomain &domain = grid.getDomain();
+    std::vector<ParticleRun> runs(grid.getStencil().offsets.size());
+    size_t cellStart = start;
+    while (cellStart < end) {
+        const uint32_t cellKey = particles.cellKey[cellStart];
+        size_t cellEnd = cellStart + 1;
+        while (cellEnd < end && particles.cellKey[cellEnd] == cellKey) {
+            cellEnd++;
+        }
+        glm::ivec3 cell = domain.getCell(glm::vec3(
+            particles.posX[cellStart], particles.posY[cellStart],
+            particles.posZ[cellStart]));
+        int runCount = gatherCellRuns(grid, cell, runs.data());
+        kernel(uint32_t(cellStart), uint32_t(cellEnd), runs.data(), runCount);
+        cellStart = cellEnd;
+    }
+}
+
+static SimdKernelParams getSimdKernelParams(const SPHSettings &settings)
+{
+    SimdKernelParams params;
+    params.h = settings.h;
+    params.h2 = settings.h2;
+    params.massPoly6 = settings.massPoly6Product;
+    params.gasConstant = settings.gasConstant;
+    params.restDensity = settings.restDensity;
+    params.pressureCoef = -settings.mass * settings.spikyGrad / 2;
+    params.viscosityCoef = settings.viscosity * settings.mass * settings.spikyLap;
+    params.densityRateCoef = -6.0f * settings.massPoly6Product;
+    return params;
+}
+
+/// Density and pressure pass over the cell grid with SIMD kernels.
+void parallelDensityAndPressuresSimd(
+    ParticleData &particles, const size_t start, const size_t end,
+    const NeighborGrid &grid, const SimdKernels &kernels,
+    const SPHSettings &settings, NeighborStats &stats)
+{
+    const SimdKernelParams params = getSimdKernelParams(settings);
+    forEachCellRange(particles, start, end, grid,
+        [&](uint32_t cellStart, uint32_t cellEnd, const ParticleRun *runs, int runCount) {
+            uint64_t candidates = 0;
+            for (int r = 0; r < runCount; r++) {
+                candidates += runs[r].end - runs[r].start;
+            }
+            // the runs hold every particle of the cell, itself included
+            stats.candidatePairs += (candidates - 1) * (cellEnd - cellStart);
+            stats.neighborPairs += kernels.densityAndPressures(
+                particles, cellStart, cellEnd, runs, runCount, params);
+        });
+}
+
+/// Force pass over the cell grid with SIMD kernels.
+void parallelForcesSimd(
+    ParticleData &particles, const size_t start, const size_t end,
+    const NeighborGrid &grid, const SimdKernels &kernels,
+    const SPHSettings &settings)
+{
+    const SimdKernelParams params = getSimdKernelParams(settings);
+    const auto forces = settings.continuityDensity
+        ? kernels.forcesAndDensityRate : kernels.forces;
+    forEachCellRange(particles, start, end, grid,
+        [&](uint32_t cellStart, uint32_t cellEnd, const ParticleRun *runs, int runCount) {
+            forces(particles, cellStart, cellEnd, runs, runCount, params);
+        });
+}
+
+/// Density and pressure pass over the Verlet neighbour lists.
+void parallelDensityAndPressuresList(
+    ParticleData &particles, const size_t start, const size_t end,
+    const NeighborList &neighborList, const SPHSettings &settings,
+    NeighborStats &stats)
+{
+	const float *posX = particles.posX;
+	const float *posY = particles.posY;
+	const float *posZ = particles.posZ;
+	const uint32_t *offsets = neighborList.getOffsets();
+	const uint32_t *neighbors = neighborList.getNeighbors();
+	float massPoly6Product = settings.mass * settings.poly6;
+	uint64_t neighborPairs = 0;
+
+	for (size_t piIndex = start; piIndex < end; piIndex++) {
+		float pDensity = 0;
+		uint32_t inRange = 0;
+		glm::vec3 pi(posX[piIndex], posY[piIndex], posZ[piIndex]);
+		for (uint32_t k = offsets[piIndex]; k < offsets[piIndex + 1]; k++) {
+			uint32_t pjIndex = neighbors[k];
+			float dx = posX[pjIndex] - pi.x;
+			float dy = posY[pjIndex] - pi.y;
+			float dz = posZ[pjIndex] - pi.z;
+			float dist2 = dx * dx + dy * dy + dz * dz;
+			if (dist2 < settings.h2) {
+				inRange++;
+				pDensity += massPoly6Product
+                    * glm::pow(settings.h2 - dist2, 3);
+			}
+		}
+
+		float density = pDensity + settings.selfDens;
+		particles.density[piIndex] = density;
+		// the list length is what the passes pay for
+		particles.neighborCount[piIndex] = offsets[piIndex + 1] - offsets[piIndex];
+		neighborPairs += inRange;
+		particles.pressure[piIndex]
+            = settings.gasConstant * (density - settings.restDensity);
+	}
+
+	stats.candidatePairs += offsets[end] - offsets[start];
+	stats.neighborPairs += neighborPairs;
+}
+
+/// Force pass over the Verlet neighbour lists.
+void parallelForcesList(
+    ParticleData &particles, const size_t start, const size_t end,
+    const NeighborList &neighborList, const SPHSettings &settings)
+{
+	const float *posX = particles.posX;
+	const float *posY = particles.posY;
+	const float *posZ = particles.posZ;
+	const float *velX = particles.velX;
+	const float *velY = particles.velY;
+	const float *velZ = particles.velZ;
+	const float *pressure = particles.pressure;
+	const float *density = particles.density;
+	const uint32_t *offsets = neighborList.getOffsets();
+	const uint32_t *neighbors = neighborList.getNeighbors();
+	const bool continuity = settings.continuityDensity;
+
+	for (size_t piIndex = start; piIndex < end; piIndex++) {
+		glm::vec3 pi(posX[piIndex], posY[piIndex], posZ[piIndex]);
+		glm::vec3 vi(velX[piIndex], velY[piIndex], velZ[piIndex]);
+		float piPressure = pressure[piIndex];
+		glm::vec3 force(0);
+		float densityRate = 0;
+		for (uint32_t k = offsets[piIndex]; k < offsets[piIndex + 1]; k++) {
+			uint32_t pjIndex = neighbors[k];
+			glm::vec3 pj(posX[pjIndex], posY[pjIndex], posZ[pjIndex]);
+			float dist2 = glm::length2(pj - pi);
+			if (dist2 < settings.h2) {
+				glm::vec3 vj(velX[pjIndex], velY[pjIndex], velZ[pjIndex]);
+				force += pairForce(
+                    pj - pi, dist2, vj - vi, piPressure, pressure[pjIndex],
+                    density[pjIndex], settings);
+				if (continuity) {
+					densityRate += pairDensityRate(pj - pi, dist2, vj - vi, settings);
+				}
+			}
+		}
+
+		particles.forceX[piIndex] = force.x;
+		particles.forceY[piIndex] = force.y;
+		particles.forceZ[piIndex] = force.z;
+		if (continuity) {
+			particles.densityRate[piIndex] = densityRate;
+		}
+	}
+}
+
+/// Adds the forces between particle i and the particles of the runs to
+/// both sides. The pair terms are the ones of pairForce, which only differ
+/// between the two sides by the density they divide by.
+static inline void addHalfStencilForces(
+    ParticleData &particles, uint32_t piIndex, const ParticleRun *runs,
+    int runCount, const SPHSettings &settings)
+{
+    const glm::vec3 pi(
+        particles.posX[piIndex], particles.posY[piIndex], particles.posZ[piIndex]);
+    const glm::vec3 vi(
+        particles.velX[piIndex], particles.velY[piIndex], particles.velZ[piIndex]);
+    const float piPressure = particles.pressure[piIndex];
+    const float piDensity = particles.density[piIndex];
+    const float pressureCoef = -settings.mass * settings.spikyGrad / 2.0f;
+    const float viscosityCoef = settings.viscosity * settings.mass * settings.spikyLap;
+    const float densityRateCoef = -6.0f * settings.massPoly6Product;
+    const bool continuity = settings.continuityDensity;
+    glm::vec3 force(0);
+    float densityRate = 0;
+
+    for (int r = 0; r < runCount; r++) {
+        for (uint32_t pjIndex = runs[r].start; pjIndex < runs[r].end; pjIndex++) {
+            glm::vec3 offset = glm::vec3(
+                particles.posX[pjIndex], particles.posY[pjIndex],
+                particles.posZ[pjIndex]) - pi;
+            float dist2 = glm::length2(offset);
+            if (dist2 >= settings.h2 || dist2 == 0.0f) {
+                continue;
+            }
+            float dist = std::sqrt(dist2);
+            float falloff = settings.h - dist;
+            glm::vec3 velocityDif = glm::vec3(
+                particles.velX[pjIndex], particles.velY[pjIndex],
+                particles.velZ[pjIndex]) - vi;
+
+            // force on i times the density of j, and minus that of j
+            // times the density of i
+            glm::vec3 shared
+                = offset * (pressureCoef * (piPressure + particles.pressure[pjIndex])
+                    * falloff * falloff / dist)
+                + velocityDif * (viscosityCoef * falloff);
+            force += shared / particles.density[pjIndex];
+            glm::vec3 reaction = shared / piDensity;
+            particles.forceX[pjIndex] -= reaction.x;
+            particles.forceY[pjIndex] -= reaction.y;
+            particles.forceZ[pjIndex] -= reaction.z;
+
+            // the density rate term is symmetric
+            if (continuity) {
+                float t = settings.h2 - dist2;
+                float rate = densityRateCoef * t * t * glm::dot(velocityDif, offset);
+                densityRate += rate;
+                particles.densityRate[pjIndex] += rate;
+            }
+        }
+    }
+
+    particles.forceX[piIndex] += force.x;
+    particles.forceY[piIndex] += force.y;
+    particles.forceZ[piIndex] += force.z;
+    if (continuity) {
+        particles.densityRate[piIndex] += densityRate;
+    }
+}
+
+/// Force pass over the cell grid that evaluates every pair once and adds
+/// equal and opposite contributions to both particles.
+///
+/// A cell only writes into itself and its half stencil, which lies in the
+/// same or the next reach z layers. The layers are therefore processed in
+/// reach + 1 colors, e.g. even then odd for cells of h, and no two threads
+/// ever write the same particle.
+void parallelForcesHalfStencil(
+    ThreadPool &threadPool, ParticleData &particles, const NeighborGrid &grid,
+    const SPHSettings &settings)
+{
+    const CellDomain &domain = grid.getDomain();
+    const uint32_t *cellStarts = grid.getCellStarts();
+    const uint32_t *cellEnds = grid.getCellEnds();
+    const uint32_t *occupiedCells = grid.getOccupiedCells();
+    const size_t occupiedCount = grid.getOccupiedCount();
+    const int layerCount = domain.dims.z;
+    const CellStencil &stencil = grid.getStencil();
+    const int colorCount = stencil.getReach() + 1;
+
+    // Bucket the occupied cells by z layer, keeping their key order
+    auto getCell = [&](uint32_t cellKey) {
+        uint32_t first = cellStarts[cellKey];
+        return domain.getCell(glm::vec3(
+            particles.posX[first], particles.posY[first], particles.posZ[first]));
+    };
+    std::vector<uint32_t> layerStarts(layerCount + 1, 0);
+    std::vector<uint32_t> layerCells(occupiedCount);
+    std::vector<glm::ivec3> cells(occupiedCount);
+    threadPool.parallelFor(occupiedCount, [&](size_t start, size_t end) {
+        for (size_t c = start; c < end; c++) {
+            cells[c] = getCell(occupiedCells[c]);
+        }
+    });
+    for (size_t c = 0; c < occupiedCount; c++) {
+        layerStarts[cells[c].z + 1]++;
+    }
+    for (int layer = 0; layer < layerCount; layer++) {
+        layerStarts[layer + 1] += layerStarts[layer];
+    }
+    {
+        std::vector<uint32_t> fill(layerStarts.begin(), layerStarts.end() - 1);
+        for (size_t c = 0; c < occupiedCount; c++) {
+            layerCells[fill[cells[c].z]++] = uint32_t(c);
+        }
+    }
+
+    threadPool.parallelFor(particles.count, [&](size_t start, size_t end) {
+        std::fill(particles.forceX + start, particles.forceX + end, 0.0f);
+        std::fill(particles.forceY + start, particles.forceY + end, 0.0f);
+        std::fill(particles.forceZ + start, particles.forceZ + end, 0.0f);
+        if (settings.continuityDensity) {
+            std::fill(particles.densityRate + start, particles.densityRate + end, 0.0f);
+        }
+    });
+
+    for (int color = 0; color < colorCount; color++) {
+        // Layers of one color are handed out one at a time, so a dense
+        // layer doesn't hold up a whole block of them
+        std::atomic<int> nextLayer{color};
+        threadPool.run([&](size_t, size_t) {
+            std::vector<ParticleRun> runs(stencil.halfOffsets.size() + 1);
+            for (int layer = nextLayer.fetch_add(colorCount); layer < layerCount;
+                 layer = nextLayer.fetch_add(colorCount)) {
+                for (uint32_t l = layerStarts[layer]; l < layerStarts[layer + 1]; l++) {
+                    const uint32_t c = layerCells[l];
+                    const uint32_t cellKey = occupiedCells[c];
+                    const uint32_t cellStart = cellStarts[cellKey];
+                    const uint32_t cellEnd = cellEnds[cellKey];
+
+                    // The rest of the own cell, then the non-empty half
+                    // stencil cells, merged where adjacent in memory
+                    int runCount = 1;
+                    runs[0] = ParticleRun{cellStart, cellEnd};
+                    for (const glm::ivec3 &offset : stencil.halfOffsets) {
+                        glm::ivec3 neighborCell = cells[c] + offset;
+                        if (!domain.contains(neighborCell)) {
+                            continue;
+                        }
+                        uint32_t neighborKey = domain.getKey(neighborCell);
+                        uint32_t runStart = cellStarts[neighborKey];
+                        uint32_t runEnd = cellEnds[neighborKey];
+                        if (runStart == runEnd) {
+                            continue;
+                        }
+                        if (runs[runCount - 1].end == runStart) {
+                            runs[runCount - 1].end = runEnd;
+                        }
+                        else {
+                            runs[runCount++] = ParticleRun{runStart, runEnd};
+                        }
+                    }
+
+                    for (uint32_t piIndex = cellStart; piIndex < cellEnd; piIndex++) {
+                        runs[0].start = piIndex + 1;
+                        addHalfStencilForces(
+                            particles, piIndex, runs.data(), runCount, settings);
+                    }
+                }
+            }
+        });
+    }
+}
+
 /// Parallel computation function moving positions
 /// of particles in the given SPH System.
+/// Also returns the bounds of the moved particles, which place the cell
+/// domain of the next step, and the motion bounds of the adaptive time
+/// step.
 void parallelUpdateParticlePositions(
-    Particle *particles, const size_t particleCount, const size_t start,
-    const size_t end, glm::mat4 *particleTransforms,
-    const SPHSettings &settings, const float &deltaTime)
+    ParticleData &particles, const size_t start, const size_t end,
+    const SPHSettings &settings, const float &deltaTime,
+    const CellDomain &keyDomain, glm::vec3 &lower, glm::vec3 &upper,
+    MotionBounds &motion)
 {
-    glm::mat4 sphereScale = glm::scale(glm::mat4(1.0f),glm::vec3(settings.h / 2.f));
     float boxWidth = 8.f;
     float elasticity = 0.5f;
+    float maxSpeed2 = 0.0f;
+    float maxAcceleration2 = 0.0f;
 
 	for (size_t i = start; i < end; i++) {
-		Particle *p = &particles[i];
+		glm::vec3 position(particles.posX[i], particles.posY[i], particles.posZ[i]);
+		glm::vec3 velocity(particles.velX[i], particles.velY[i], particles.velZ[i]);
+		glm::vec3 force(particles.forceX[i], particles.forceY[i], particles.forceZ[i]);
 
 		//calculate acceleration and velocity
-		glm::vec3 acceleration = p->force / p->density + glm::vec3(0, settings.g, 0);
-		p->velocity += acceleration * deltaTime;
+		glm::vec3 acceleration = force / particles.density[i] + glm::vec3(0, settings.g, 0);
+		velocity += acceleration * deltaTime;
+		maxAcceleration2 = std::max(maxAcceleration2, glm::length2(acceleration));
 
 		// Update position
-		p->position += p->velocity * deltaTime;
+		position += velocity * deltaTime;
 
 		// Handle collisions with box
-		if (p->position.y < settings.h) {
-			p->position.y = -p->position.y + 2 * settings.h + 0.0001f;
-			p->velocity.y = -p->velocity.y * elasticity;
+		if (position.y < settings.h) {
+			position.y = -position.y + 2 * settings.h + 0.0001f;
+			velocity.y = -velocity.y * elasticity;
 		}
 
-		if (p->position.x < settings.h - boxWidth) {
-			p->position.x = -p->position.x + 2 * (settings.h - boxWidth) + 0.0001f;
-			p->velocity.x = -p->velocity.x * elasticity;
+		if (position.x < settings.h - boxWidth) {
+			position.x = -position.x + 2 * (settings.h - boxWidth) + 0.0001f;
+			velocity.x = -velocity.x * elasticity;
 		}
 
-		if (p->position.x > -settings.h + boxWidth) {
-			p->position.x = -p->position.x + 2 * -(settings.h - boxWidth) - 0.0001f;
-			p->velocity.x = -p->velocity.x * elasticity;
+		if (position.x > -settings.h + boxWidth) {
+			position.x = -position.x + 2 * -(settings.h - boxWidth) - 0.0001f;
+			velocity.x = -velocity.x * elasticity;
 		}
 
-		if (p->position.z < settings.h - boxWidth) {
-			p->position.z = -p->position.z + 2 * (settings.h - boxWidth) + 0.0001f;
-			p->velocity.z = -p->velocity.z * elasticity;
+		if (position.z < settings.h - boxWidth) {
+			position.z = -position.z + 2 * (settings.h - boxWidth) + 0.0001f;
+			velocity.z = -velocity.z * elasticity;
 		}
 
-		if (p->position.z > -settings.h + boxWidth) {
-			p->position.z = -p->position.z + 2 * -(settings.h - boxWidth) - 0.0001f;
-			p->velocity.z = -p->velocity.z * elasticity;
+		if (position.z > -settings.h + boxWidth) {
+			position.z = -position.z + 2 * -(settings.h - boxWidth) - 0.0001f;
+			velocity.z = -velocity.z * elasticity;
 		}
 
-        particleTransforms[i]
-            = glm::translate(glm::mat4(1.0f),p->position) * sphereScale;
+		lower = glm::min(lower, position);
+		upper = glm::max(upper, position);
+		maxSpeed2 = std::max(maxSpeed2, glm::length2(velocity));
+
+		particles.posX[i] = position.x;
+		particles.posY[i] = position.y;
+		particles.posZ[i] = position.z;
+		particles.velX[i] = velocity.x;
+		particles.velY[i] = velocity.y;
+		particles.velZ[i] = velocity.z;
+
+        // The density follows the continuity equation, but never drops
+        // below that of a particle without neighbours
+        if (settings.continuityDensity) {
+            float density = std::max(
+                particles.density[i] + particles.densityRate[i] * deltaTime,
+                settings.selfDens);
+            particles.density[i] = density;
+            particles.pressure[i]
+                = settings.gasConstant * (density - settings.restDensity);
+        }
+
+        // next step's key while the position is still in registers
+        particles.cellKey[i] = keyDomain.getKey(keyDomain.getCell(position));
 	}
+
+    motion.maxSpeed = std::sqrt(maxSpeed2);
+    motion.maxAcceleration = std::sqrt(maxAcceleration2);
 }
 
-/// Sort particles by the particle's hash
-void sortParticles(Particle *particles, const size_t &particleCount)
+/// Gathers the particle state in the given order into the sort buffer, in
+/// parallel, and swaps the containers. Density, pressure and force are
+/// recomputed every step and are not carried over; the neighbour counts
+/// are, as the cost estimate of the next task split.
+void gatherParticles(
+    ThreadPool &threadPool, ParticleData &particles, ParticleData &sortBuffer,
+    const uint32_t *order, bool withDensity)
 {
-    std::sort(
-        particles, particles + particleCount,
-        [&](const Particle& i, const Particle& j) {
-            return i.hash < j.hash;
+    const size_t particleCount = particles.count;
+    if (sortBuffer.count != particleCount) {
+        sortBuffer.allocate(particleCount);
+    }
+
+    threadPool.parallelFor(particleCount, [&](size_t start, size_t end) {
+        for (size_t i = start; i < end; i++) {
+            uint32_t src = order[i];
+            sortBuffer.posX[i] = particles.posX[src];
+            sortBuffer.posY[i] = particles.posY[src];
+            sortBuffer.posZ[i] = particles.posZ[src];
+            sortBuffer.velX[i] = particles.velX[src];
+            sortBuffer.velY[i] = particles.velY[src];
+            sortBuffer.velZ[i] = particles.velZ[src];
+            sortBuffer.cellKey[i] = particles.cellKey[src];
+            sortBuffer.neighborCount[i] = particles.neighborCount[src];
         }
-    );
+        if (withDensity) {
+            for (size_t i = start; i < end; i++) {
+                sortBuffer.density[i] = particles.density[order[i]];
+                sortBuffer.pressure[i] = particles.pressure[order[i]];
+            }
+        }
+    });
+    particles.swap(sortBuffer);
 }
 
-/// CPU update particles implementation
-void updateParticlesCPU(Particle *particles, glm::mat4 *particleTransforms,const size_t particleCount, const SPHSettings &settings, float deltaTime)
+/// Sort particles by the particle's cell key.
+/// The keys are radix sorted into a permutation, or only the movers are
+/// when index allows it, and the particle state is then gathered once.
+bool sortParticles(
+    ThreadPool &threadPool, RadixSorter &sorter, ParticleData &particles,
+    ParticleData &sortBuffer, uint32_t maxKey, const NeighborGrid *index,
+    size_t maxMovers, bool withDensity)
 {
-    const size_t threadCount = std::thread::hardware_concurrency();
-    vector<thread> threads(threadCount);
-
-    vector<size_t> blockBoundaries(threadCount + 1);
-    blockBoundaries[0] = 0;
-    size_t blockSize = particleCount / threadCount;
-    for (size_t i = 1; i < threadCount; i++) {
-        blockBoundaries[i] = i * blockSize;
+    const uint32_t *order = nullptr;
+    if (index && index->hasIndex()) {
+        order = sorter.resort(
+            threadPool, particles.cellKey, particles.count, maxKey, *index,
+            maxMovers);
+    }
+    const bool incremental = order != nullptr;
+    if (!incremental) {
+        order = sorter.sort(threadPool, particles.cellKey, particles.count, maxKey);
     }
-    blockBoundaries[threadCount] = particleCount;
+    gatherParticles(threadPool, particles, sortBuffer, order, withDensity);
+    return incremental;
+}
 
-    // Calculate hashes
-    {
-        //Timer timer("hashes");
-        for (int i = 0; i < threadCount; i++) {
-            threads[i] = std::thread(
-                parallelCalculateHashes, particles, blockBoundaries[i],
-                blockBoundaries[i + 1], settings);
+float getCellSize(const SPHSettings &settings)
+{
+    // Lists gather everything within h + skin, so their cells divide that
+    float radius = settings.useNeighborList ? settings.h + settings.neighborSkin : settings.h;
+    return radius / float(settings.cellsPerRadius);
+}
+
+void computeCellKeys(
+    ThreadPool &threadPool, ParticleData &particles, const CellDomain &domain)
+{
+    threadPool.parallelFor(particles.count, [&](size_t start, size_t end) {
+        parallelCalculateCellKeys(particles, start, end, domain);
+    });
+}
+
+void computeDensities(
+    ThreadPool &threadPool, const ParticleTasks &tasks,
+    ParticleData &particles, const NeighborGrid &grid,
+    const NeighborList &neighborList, const SPHSettings &settings,
+    NeighborStats &stats)
+{
+    const bool useNeighborList = settings.useNeighborList;
+    // The SIMD kernels walk the cell ranges, the lists stay scalar
+    const SimdKernels *simdKernels
+        = useNeighborList ? nullptr : getSimdKernels(settings.simdLevel);
+    std::atomic<uint64_t> candidatePairs{0};
+    std::atomic<uint64_t> neighborPairs{0};
+    tasks.run(threadPool, [&](size_t start, size_t end, size_t) {
+        NeighborStats blockStats;
+        if (useNeighborList) {
+            parallelDensityAndPressuresList(
+                particles, start, end, neighborList, settings, blockStats);
+        }
+        else if (simdKernels) {
+            parallelDensityAndPressuresSimd(
+                particles, start, end, grid, *simdKernels, settings,
+                blockStats);
         }
-        for (std::thread& thread : threads) {
-            thread.join();
+        else {
+            parallelDensityAndPressures(
+                particles, start, end, grid, settings, blockStats);
         }
+        candidatePairs += blockStats.candidatePairs;
+        neighborPairs += blockStats.neighborPairs;
+    });
+    stats.candidatePairs = candidatePairs;
+    stats.neighborPairs = neighborPairs;
+}
+
+void computeForces(
+    ThreadPool &threadPool, const ParticleTasks &tasks,
+    ParticleData &particles, const NeighborGrid &grid,
+    const NeighborList &neighborList, const SPHSettings &settings)
+{
+    const bool useNeighborList = settings.useNeighborList;
+    if (!useNeighborList && settings.halfStencil) {
+        parallelForcesHalfStencil(threadPool, particles, grid, settings);
+        return;
     }
+    const SimdKernels *simdKernels
+        = useNeighborList ? nullptr : getSimdKernels(settings.simdLevel);
+    tasks.run(threadPool, [&](size_t start, size_t end, size_t) {
+        if (useNeighborList) {
+            parallelForcesList(
+                particles, start, end, neighborList, settings);
+        }
+        else if (simdKernels) {
+            parallelForcesSimd(
+                particles, start, end, grid, *simdKernels, settings);
+        }
+        else {
+            parallelForces(particles, start, end, grid, settings);
+        }
+    });
+}
 
-    // Sort particles
-    {
-        //Timer timer("sort");
-        sortParticles(particles, particleCount);
+bool integrateParticles(
+    ThreadPool &threadPool, const ParticleTasks &tasks,
+    ParticleData &particles, const SPHSettings &settings, float deltaTime,
+    const CellDomain &keyDomain, glm::vec3 &lower, glm::vec3 &upper,
+    MotionBounds &motion)
+{
+    const size_t threadCount = threadPool.size();
+    std::vector<glm::vec3> blockLower(threadCount, glm::vec3(FLT_MAX));
+    std::vector<glm::vec3> blockUpper(threadCount, glm::vec3(-FLT_MAX));
+    std::vector<MotionBounds> blockMotion(threadCount);
+    // A worker runs several tasks, their bounds accumulate per worker
+    tasks.run(threadPool, [&](size_t start, size_t end, size_t threadIndex) {
+        MotionBounds taskMotion;
+        parallelUpdateParticlePositions(
+            particles, start, end, settings, deltaTime, keyDomain,
+            blockLower[threadIndex], blockUpper[threadIndex], taskMotion);
+        MotionBounds &workerMotion = blockMotion[threadIndex];
+        workerMotion.maxSpeed = std::max(workerMotion.maxSpeed, taskMotion.maxSpeed);
+        workerMotion.maxAcceleration
+            = std::max(workerMotion.maxAcceleration, taskMotion.maxAcceleration);
+    });
+
+    lower = blockLower[0];
+    upper = blockUpper[0];
+    motion = blockMotion[0];
+    for (size_t t = 1; t < threadCount; t++) {
+        lower = glm::min(lower, blockLower[t]);
+        upper = glm::max(upper, blockUpper[t]);
+        motion.maxSpeed = std::max(motion.maxSpeed, blockMotion[t].maxSpeed);
+        motion.maxAcceleration
+            = std::max(motion.maxAcceleration, blockMotion[t].maxAcceleration);
     }
+    return particles.count == 0 || keyDomain.containsBounds(lower, upper);
+}
 
-    uint32_t *particleTable
-        = createNeighborTable(particles, particleCount);
+float getAdaptiveTimeStep(
+    const SPHSettings &settings, const MotionBounds &motion)
+{
+    // CFL: no particle or pressure wave crosses more than a fraction of h;
+    // the equation of state p = k (rho - rho0) has sound speed sqrt(k)
+    float soundSpeed = std::sqrt(settings.gasConstant);
+    float timeStep = settings.cflFactor * settings.h / (soundSpeed + motion.maxSpeed);
+    // force: the largest acceleration moves a particle at most ~h
+    if (motion.maxAcceleration > 0.0f) {
+        timeStep = std::min(timeStep,
+            settings.forceFactor * std::sqrt(settings.h / motion.maxAcceleration));
+    }
+    // viscous diffusion over h, with the kinematic viscosity at rest density
+    if (settings.viscosity > 0.0f) {
+        timeStep = std::min(timeStep,
+            settings.viscousFactor * settings.h2 * settings.restDensity / settings.viscosity);
+    }
+    return glm::clamp(timeStep, settings.minTimeStep, settings.maxTimeStep);
+}
 
-    // Calculate densities and pressures
-    {
-        Timer timer("densities");
-        for (int i = 0; i < threadCount; i++) {
-            threads[i] = std::thread(
-                parallelDensityAndPressures, particles, particleCount,
-                blockBoundaries[i], blockBoundaries[i + 1], particleTable,
-                settings);
+glm::vec2 computeInstances(
+    ThreadPool &threadPool, const ParticleData &particles,
+    const SPHSettings &settings, ParticleInstance *instances)
+{
+    const InstanceAttribute attribute = settings.instanceAttribute;
+    const size_t threadCount = threadPool.size();
+    std::vector<glm::vec2> blockRanges(threadCount, glm::vec2(FLT_MAX, -FLT_MAX));
+    threadPool.run([&](size_t threadIndex, size_t threadCount) {
+        size_t start, end;
+        ThreadPool::blockRange(particles.count, threadIndex, threadCount, start, end);
+        glm::vec2 range = blockRanges[threadIndex];
+        for (size_t i = start; i < end; i++) {
+            float value = 0.0f;
+            switch (attribute) {
+            case InstanceAttribute::Density:
+                value = particles.density[i];
+                break;
+            case InstanceAttribute::Pressure:
+                value = particles.pressure[i];
+                break;
+            case InstanceAttribute::Speed:
+                value = std::sqrt(particles.velX[i] * particles.velX[i]
+                    + particles.velY[i] * particles.velY[i]
+                    + particles.velZ[i] * particles.velZ[i]);
+                break;
+            case InstanceAttribute::None:
+                break;
+            }
+            ParticleInstance &instance = instances[i];
+            instance.position = glm::vec3(
+                particles.posX[i], particles.posY[i], particles.posZ[i]);
+            instance.value = value;
+            range.x = std::min(range.x, value);
+            range.y = std::max(range.y, value);
+        }
+        blockRanges[threadIndex] = range;
+    });
+
+    glm::vec2 range = blockRanges[0];
+    for (size_t t = 1; t < threadCount; t++) {
+        range.x = std::min(range.x, blockRanges[t].x);
+        range.y = std::max(range.y, blockRanges[t].y);
+    }
+    return particles.count == 0 ? glm::vec2(0.0f) : range;
+}
+
+// An incremental sort gives up once more than 1 / MAX_MOVER_SHARE of the
+// particles moved, a full sort is about as fast then
+static const size_t MAX_MOVER_SHARE = 4;
+
+/// CPU update particles implementation
+void updateParticlesCPU(
+    ThreadPool &threadPool, RadixSorter &sorter, NeighborGrid &grid,
+    NeighborList &neighborList, ParticleTasks &tasks, ParticleData &particles,
+    ParticleData &sortBuffer, const SPHSettings &settings, float deltaTime,
+    NeighborStats &stats, MotionBounds &motion, ContinuityState &continuity)
+{
+    SPH_PROFILE_ZONE("step");
+    const size_t particleCount = particles.count;
+    const bool useNeighborList = settings.useNeighborList;
+    const float cellSize = getCellSize(settings);
+    // The continuity density carries the densities from step to step and
+    // only sums them when they are new or due
+    const bool sumDensities = !settings.continuityDensity || !continuity.valid
+        || (settings.densityReinitInterval > 0
+            && continuity.stepsSinceSummation >= settings.densityReinitInterval);
+
+    // Verlet lists keep the particle order until a particle moved too far
+    bool searchNeighbors = !useNeighborList
+        || neighborList.needsRebuild(threadPool, particles, settings.neighborSkin);
+    stats.sortedParticles = 0;
+    if (searchNeighbors) {
+        // The last integration computed the keys, unless there was none
+        // or the cells changed since
+        const CellDomain &current = grid.getDomain();
+        if (!grid.hasDomain() || current.cellSize != cellSize
+            || current.order != settings.cellOrder
+            || grid.getStencil().cellsPerRadius != settings.cellsPerRadius) {
+            SPH_PROFILE_ZONE("cell keys");
+            fitCellDomain(
+                threadPool, particles, grid, cellSize, settings.cellOrder,
+                settings.cellsPerRadius);
+            computeCellKeys(threadPool, particles, grid.getDomain());
+        }
+        const CellDomain &domain = grid.getDomain();
+
+        // Sort particles. Few of them change cell between two sorts, so
+        // while the grid still indexes the current order only those are
+        // re-sorted, with a full sort every fullSortInterval steps
+        {
+            SPH_PROFILE_ZONE("sort");
+            bool tryIncremental = settings.incrementalSort
+                && (settings.fullSortInterval <= 0
+                    || sorter.getResortStreak() + 1 < size_t(settings.fullSortInterval));
+            bool incremental = sortParticles(
+                threadPool, sorter, particles, sortBuffer,
+                domain.getKeyCount() - 1, tryIncremental ? &grid : nullptr,
+                particleCount / MAX_MOVER_SHARE, !sumDensities);
+            stats.sortedParticles = incremental ? sorter.getMoverCount() : particleCount;
         }
-        for (std::thread& thread : threads) {
-            thread.join();
+
+        // Index the cells of the sorted particles
+        {
+            SPH_PROFILE_ZONE("grid");
+            grid.build(threadPool, particles.cellKey, particleCount);
+        }
+
+        if (useNeighborList) {
+            SPH_PROFILE_ZONE("neighbor lists");
+            neighborList.build(
+                threadPool, particles, grid, settings.h + settings.neighborSkin);
         }
+        else {
+            neighborList.invalidate();
+        }
+    }
+
+    // Split the particles by the neighbour counts of the last step
+    {
+        SPH_PROFILE_ZONE("tasks");
+        tasks.build(threadPool, particles, settings.workStealing);
+    }
+
+    // Calculate densities and pressures
+    if (sumDensities) {
+        SPH_PROFILE_ZONE("densities");
+        computeDensities(
+            threadPool, tasks, particles, grid, neighborList, settings, stats);
+        continuity.stepsSinceSummation = 0;
     }
+    continuity.valid = settings.continuityDensity;
 
     // Calculate forces
     {
-        Timer timer("forces");
-        for (int i = 0; i < threadCount; i++) {
-            threads[i] = std::thread(
-                parallelForces, particles, particleCount, blockBoundaries[i],
-                blockBoundaries[i + 1], particleTable, settings);
-        }
-        for (std::thread& thread : threads) {
-            thread.join();
-        }
+        SPH_PROFILE_ZONE("forces");
+        computeForces(threadPool, tasks, particles, grid, neighborList, settings);
     }
 
-    // Update particle positions
+    // Update particle positions and the next step's cell keys
     {
-        Timer timer("positions");
-        for (int i = 0; i < threadCount; i++) {
-            threads[i] = std::thread(
-                parallelUpdateParticlePositions, particles, particleCount,
-                blockBoundaries[i], blockBoundaries[i + 1], particleTransforms,
-                settings, deltaTime);
+        SPH_PROFILE_ZONE("integration");
+        glm::vec3 lower, upper;
+        bool keysValid = integrateParticles(
+            threadPool, tasks, particles, settings, deltaTime,
+            grid.getDomain(), lower, upper, motion);
+        if (settings.continuityDensity) {
+            continuity.stepsSinceSummation++;
         }
-        for (std::thread& thread : threads) {
-            thread.join();
+        // Refit when particles left the domain, which piles them into the
+        // border cells, or when it outgrew them, e.g. after a splash
+        if (!keysValid || grid.getDomain().isOversized(lower, upper)) {
+            SPH_PROFILE_ZONE("cell keys");
+            grid.setDomain(
+                lower, upper, cellSize, settings.cellOrder, settings.cellsPerRadius);
+            computeCellKeys(threadPool, particles, grid.getDomain());
         }
     }
-
-    delete(particleTable);
 }
 
 void updateParticles(
-    Particle *particles, glm::mat4 *particleTransforms,
-    const size_t particleCount, const SPHSettings &settings,
-    float deltaTime, const bool onGPU)
+    ThreadPool &threadPool, RadixSorter &sorter, NeighborGrid &grid,
+    NeighborList &neighborList, ParticleTasks &tasks, ParticleData &particles,
+    ParticleData &sortBuffer, const SPHSettings &settings, float deltaTime,
+    const bool onGPU, NeighborStats &stats, MotionBounds &motion,
+    ContinuityState &continuity)
 {
     if (onGPU) {
         updateParticlesCPU(
-            particles, particleTransforms, particleCount, settings, deltaTime);
+            threadPool, sorter, grid, neighborList, tasks, particles,
+            sortBuffer, settings, deltaTime, stats, motion, continuity);
     }
     else {
         updateParticlesCPU(
-            particles, particleTransforms, particleCount, settings, deltaTime);
+            threadPool, sorter, grid, neighborList, tasks, particles,
+            sortBuffer, settings, deltaTime, stats, motion, continuity);
     }
 }
\ No newline at end of file
@@ -2,38 +2,165 @@
 #define SPH_SPH_H
 
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/norm.hpp>
-#include "SphSystem.h"
+#include "profiler.h"
+#include "threadPool.h"
+#include "sphParticles.h"
+#include "sphSettings.h"
+#include "radixSort.h"
+#include "neighborGrid.h"
+#include "neighborList.h"
+#include "particleTasks.h"
+#include "sphSimd.h"
 
-//-----------------------adjTable--------------------------------//
-const uint32_t TABLE_SIZE = 262144;
-const uint32_t NO_PARTICLE = 0xFFFFFFFF;
+//-----------------------cell grid-------------------------------//
+/// Fits the grid's cell domain around the current particle positions.
+/// Only needed when the grid has no domain yet; afterwards every step
+/// places the domain of the next one.
+void fitCellDomain(
+    ThreadPool &threadPool, const ParticleData &particles, NeighborGrid &grid,
+    float cellSize, CellOrder order, int cellsPerRadius);
 
-/// Returns a hash of the cell position
-uint32_t getHash(const glm::ivec3 &cell);
+//---------------------------------------------------------------//
 
-/// Get the cell that the particle is in.
-glm::ivec3 getCell(Particle* p, float h);
 
-/// Creates the particle neighbor hash table.
-/// It is the caller's responsibility to free the table.
-uint32_t* createNeighborTable(Particle *sortedParticles, const size_t &particleCount);
+//----------------------calculation------------------------------//
+/// Calculates and stores the cell key of every particle.
+void parallelCalculateCellKeys(ParticleData &particles, size_t start, size_t end, const CellDomain &domain);
 
+/// Sort particles by cell key with a parallel radix sort. The particle
+/// state is gathered into sortBuffer in key order and the two containers
+/// are swapped afterwards. All keys must be <= maxKey.
+/// With index, the grid built for the current order and still valid for
+/// the current keys, only the particles that changed cell are sorted and
+/// merged back, unless more than maxMovers did. Returns whether it sorted
+/// incrementally; the order is the same either way. withDensity also
+/// gathers density and pressure, which otherwise the next density pass
+/// recomputes.
+bool sortParticles(
+    ThreadPool &threadPool, RadixSorter &sorter, ParticleData &particles,
+    ParticleData &sortBuffer, uint32_t maxKey,
+    const NeighborGrid *index = nullptr, size_t maxMovers = 0,
+    bool withDensity = false);
 
-//---------------------------------------------------------------//
+/// Gathers the particle state into sortBuffer in the given order, e.g.
+/// one of RadixSorter, and swaps the two containers.
+void gatherParticles(
+    ThreadPool &threadPool, ParticleData &particles, ParticleData &sortBuffer,
+    const uint32_t *order, bool withDensity = false);
 
+/// Largest speed and acceleration found by an integration pass, the
+/// inputs of the adaptive time step.
+struct MotionBounds
+{
+    float maxSpeed{0.0f};
+    float maxAcceleration{0.0f};
+};
 
-//----------------------calculation------------------------------//
-/// Calculates and stores particle hashes.
-void parallelCalculateHashes(Particle *particles, size_t start, size_t end, const SPHSettings &settings);
+/// Bookkeeping of settings.continuityDensity between steps.
+struct ContinuityState
+{
+    // whether the particles hold densities the next step can advance;
+    // false sums them first, e.g. after the particles were re-initialized
+    bool valid{false};
+    // steps the densities were advanced since they were last summed
+    int stepsSinceSummation{0};
+
+    void invalidate() { valid = false; }
+};
+
+//-----------------------phases-----------------------------------//
+// The phases of one CPU step, each running in parallel on the pool.
+// updateParticles chains them; benchmarks time them one by one.
+
+/// Width of the grid cells for the configured neighbour search: its
+/// radius divided by settings.cellsPerRadius.
+float getCellSize(const SPHSettings &settings);
+
+/// Cell key of every particle, over the given domain.
+void computeCellKeys(
+    ThreadPool &threadPool, ParticleData &particles, const CellDomain &domain);
+
+/// Density and pressure of every particle from the grid of the sorted
+/// particles, or from the Verlet lists with settings.useNeighborList, over
+/// the given tasks. Also stores every particle's neighbour count.
+void computeDensities(
+    ThreadPool &threadPool, const ParticleTasks &tasks,
+    ParticleData &particles, const NeighborGrid &grid,
+    const NeighborList &neighborList, const SPHSettings &settings,
+    NeighborStats &stats);
+
+/// Pressure and viscosity forces, searched like computeDensities. With
+/// settings.halfStencil the grid search visits every pair once and applies
+/// it to both particles instead, scheduled by z layers and not by tasks.
+/// With settings.continuityDensity the same pairs also sum the density
+/// rate of the continuity equation into particles.densityRate.
+void computeForces(
+    ThreadPool &threadPool, const ParticleTasks &tasks,
+    ParticleData &particles, const NeighborGrid &grid,
+    const NeighborList &neighborList, const SPHSettings &settings);
+
+/// Moves the particles, resolves the box collisions and, in the same pass,
+/// computes the cell keys of the new positions over keyDomain, so the next
+/// step needs no separate sweep for them. lower and upper receive the
+/// bounds of the moved particles and motion their largest speed and
+/// acceleration, reduced across the workers of the same pass. Returns
+/// false if a particle left keyDomain; its clamped key is still correct,
+/// but crowds the border cells until the domain is refitted.
+/// With settings.continuityDensity the densities are advanced by their
+/// rate and the pressures follow, after the accelerations used them.
+bool integrateParticles(
+    ThreadPool &threadPool, const ParticleTasks &tasks,
+    ParticleData &particles, const SPHSettings &settings, float deltaTime,
+    const CellDomain &keyDomain, glm::vec3 &lower, glm::vec3 &upper,
+    MotionBounds &motion);
+
+/// Largest stable time step after a step that ended with the given
+/// motion: the smallest of the CFL, force and viscous limits, clamped to
+/// [settings.minTimeStep, settings.maxTimeStep].
+float getAdaptiveTimeStep(
+    const SPHSettings &settings, const MotionBounds &motion);
+
+/// \struct ParticleInstance
+///
+/// Instance data of one particle sphere: its position and the scalar
+/// selected by settings.instanceAttribute, 0 with InstanceAttribute::None.
+/// shader/particle.vs scales the sphere by h / 2 and moves it to the
+/// position, so no transform is built per particle.
+struct ParticleInstance
+{
+    glm::vec3 position;
+    float value;
+};
+static_assert(sizeof(ParticleInstance) == 16, "instances are uploaded as one vec4");
 
-/// Sort particles in place by hash.
-void sortParticles(Particle *particles, const size_t &particleCount);
+/// Instance data of every particle for instanced rendering, returns the
+/// [min, max] range of the values. Not part of a step, callers build them
+/// only when they draw.
+glm::vec2 computeInstances(
+    ThreadPool &threadPool, const ParticleData &particles,
+    const SPHSettings &settings, ParticleInstance *instances);
 
 /// Update attrs of particles in place.
+/// Every parallel phase runs on the given long-lived thread pool.
+/// With settings.useNeighborList the density and force passes read Verlet
+/// lists, and sorting and neighbour search only run when the lists expire.
+/// stats receives the pair counts of this step's neighbour search, motion
+/// the bounds for the next adaptive time step.
+/// The cell keys of the next step are computed by the integration, over
+/// the grid's domain, which is only refitted when particles leave it.
+/// Density, forces and integration run on tasks, split anew every step
+/// with settings.workStealing.
+/// With settings.continuityDensity the density pass only runs on the steps
+/// continuity says need a summation; the other steps traverse the
+/// neighbours once, in the force pass. stats then keeps the pair counts
+/// of the last summation.
 void updateParticles(
-    Particle *particles, glm::mat4 *particleTransforms,
-    const size_t particleCount, const SPHSettings &settings,
-    float deltaTime, const bool onGPU);
+    ThreadPool &threadPool, RadixSorter &sorter, NeighborGrid &grid,
+    NeighborList &neighborList, ParticleTasks &tasks, ParticleData &particles,
+    ParticleData &sortBuffer, const SPHSettings &settings, float deltaTime,
+    const bool onGPU, NeighborStats &stats, MotionBounds &motion,
+    ContinuityState &continuity);
 
 #endif //SPH_SPH_H
\ No newline at end of file
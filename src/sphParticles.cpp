@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <utility>
+#include "sphParticles.h"
+#include "threadPool.h"
+
+ParticleData::ParticleData(size_t count)
+{
+    allocate(count);
+}
+
+ParticleData::~ParticleData()
+{
+    release();
+}
+
+void ParticleData::allocate(size_t count)
+{
+    release();
+    this->count = count;
+    posX = new float[count + PADDING]();
+    posY = new float[count + PADDING]();
+    posZ = new float[count + PADDING]();
+    velX = new float[count + PADDING]();
+    velY = new float[count + PADDING]();
+    velZ = new float[count + PADDING]();
+    forceX = new float[count + PADDING]();
+    forceY = new float[count + PADDING]();
+    forceZ = new float[count + PADDING]();
+    density = new float[count + PADDING]();
+    pressure = new float[count + PADDING]();
+    densityRate = new float[count + PADDING]();
+    cellKey = new uint32_t[count];
+    neighborCount = new uint32_t[count]();
+}
+
+void ParticleData::allocate(ThreadPool &threadPool, size_t count)
+{
+    release();
+    this->count = count;
+    // Without an initializer large arrays stay untouched until the workers
+    // write them
+    float **floatArrays[] = {
+        &posX, &posY, &posZ, &velX, &velY, &velZ, &forceX, &forceY, &forceZ,
+        &density, &pressure, &densityRate,
+    };
+    for (float **array : floatArrays) {
+        *array = new float[count + PADDING];
+    }
+    cellKey = new uint32_t[count];
+    neighborCount = new uint32_t[count];
+
+    threadPool.run([&](size_t threadIndex, size_t threadCount) {
+        size_t start, end;
+        ThreadPool::blockRange(count, threadIndex, threadCount, start, end);
+        // the last block also owns the padding
+        size_t floatEnd = threadIndex + 1 == threadCount ? count + PADDING : end;
+        for (float **array : floatArrays) {
+            std::fill(*array + start, *array + floatEnd, 0.0f);
+        }
+        std::fill(cellKey + start, cellKey + end, 0u);
+        std::fill(neighborCount + start, neighborCount + end, 0u);
+    });
+}
+
+void ParticleData::copyRange(const ParticleData &source, size_t start, size_t end)
+{
+    auto copy = [&](auto *target, const auto *from) {
+        std::copy(from + start, from + end, target + start);
+    };
+    copy(posX, source.posX);
+    copy(posY, source.posY);
+    copy(posZ, source.posZ);
+    copy(velX, source.velX);
+    copy(velY, source.velY);
+    copy(velZ, source.velZ);
+    copy(forceX, source.forceX);
+    copy(forceY, source.forceY);
+    copy(forceZ, source.forceZ);
+    copy(density, source.density);
+    copy(pressure, source.pressure);
+    copy(densityRate, source.densityRate);
+    copy(cellKey, source.cellKey);
+    copy(neighborCount, source.neighborCount);
+}
+
+void ParticleData::release()
+{
+    delete[] posX;
+    delete[] posY;
+    delete[] posZ;
+    delete[] velX;
+    delete[] velY;
+    delete[] velZ;
+    delete[] forceX;
+    delete[] forceY;
+    delete[] forceZ;
+    delete[] density;
+    delete[] pressure;
+    delete[] densityRate;
+    delete[] cellKey;
+    delete[] neighborCount;
+    posX = posY = posZ = nullptr;
+    velX = velY = velZ = nullptr;
+    forceX = forceY = forceZ = nullptr;
+    density = pressure = densityRate = nullptr;
+    cellKey = neighborCount = nullptr;
+    count = 0;
+}
+
+void ParticleData::swap(ParticleData &other)
+{
+    std::swap(count, other.count);
+    std::swap(posX, other.posX);
+    std::swap(posY, other.posY);
+    std::swap(posZ, other.posZ);
+    std::swap(velX, other.velX);
+    std::swap(velY, other.velY);
+    std::swap(velZ, other.velZ);
+    std::swap(forceX, other.forceX);
+    std::swap(forceY, other.forceY);
+    std::swap(forceZ, other.forceZ);
+    std::swap(density, other.density);
+    std::swap(pressure, other.pressure);
+    std::swap(densityRate, other.densityRate);
+    std::swap(cellKey, other.cellKey);
+    std::swap(neighborCount, other.neighborCount);
+}
@@ -0,0 +1,55 @@
+#ifndef SPH_PARTICLES_H
+#define SPH_PARTICLES_H
+
+#include <cstddef>
+#include <cstdint>
+
+class ThreadPool;
+
+/// \struct ParticleData
+///
+/// Structure-of-arrays particle storage. Every attribute lives in its own
+/// contiguous array, so a kernel only streams the fields it actually reads
+/// instead of pulling whole particles through the cache.
+struct ParticleData
+{
+    ParticleData() = default;
+    explicit ParticleData(size_t count);
+    ~ParticleData();
+
+    ParticleData(const ParticleData &) = delete;
+    ParticleData &operator=(const ParticleData &) = delete;
+
+    /// (Re)allocates every array for count particles, contents undefined.
+    void allocate(size_t count);
+    /// Same, but the workers zero the arrays in the blocks of
+    /// ThreadPool::parallelFor, so on a NUMA machine every page is first
+    /// touched by, and so placed on the node of, the worker that owns it.
+    void allocate(ThreadPool &threadPool, size_t count);
+    /// Copies every attribute of the particles [start, end) of source.
+    void copyRange(const ParticleData &source, size_t start, size_t end);
+    void release();
+    /// Exchanges the arrays of both containers, used after a gather.
+    void swap(ParticleData &other);
+
+    /// Every float array is readable this many elements past count, so
+    /// SIMD kernels can load a full vector at the end of a range.
+    static const size_t PADDING = 16;
+
+    size_t count{0};
+    float *posX{nullptr}, *posY{nullptr}, *posZ{nullptr};
+    float *velX{nullptr}, *velY{nullptr}, *velZ{nullptr};
+    float *forceX{nullptr}, *forceY{nullptr}, *forceZ{nullptr};
+    float *density{nullptr};
+    float *pressure{nullptr};
+    // rate of change of the density, written by the force pass of the
+    // continuity density and consumed by the integration
+    float *densityRate{nullptr};
+    // key of the grid cell the particle is in, see CellDomain
+    uint32_t *cellKey{nullptr};
+    // neighbours found by the last density pass, the cost estimate of the
+    // next step's task split; zero after allocate()
+    uint32_t *neighborCount{nullptr};
+};
+
+#endif // SPH_PARTICLES_H
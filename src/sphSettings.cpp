@@ -0,0 +1,48 @@
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include "sphSettings.h"
+
+namespace {
+const float KERNEL_PI = 3.14159265f;
+}
+
+SPHSettings::SPHSettings(
+    float mass, float restDensity, float gasConstant, float viscosity, float h,
+    float g, float tension):
+    mass(mass),
+    restDensity(restDensity),
+    gasConstant(gasConstant),
+    viscosity(viscosity),
+    h(h),
+    g(g),
+    tension(tension)
+{
+    //pre-compute coeffs
+    poly6 = 315.0f / (64.0f * KERNEL_PI * std::pow(h, 9));//kernel funct
+    spikyGrad = -45.0f / (KERNEL_PI * std::pow(h, 6));//pressure forces
+    spikyLap = 45.0f / (KERNEL_PI * std::pow(h, 6));//viscosity forces
+    h2 = h * h;
+    selfDens = mass * poly6 * std::pow(h, 6); //The density contribution of a particle to itself
+    massPoly6Product = mass * poly6; // Used in density calculations involving neighboring particles.
+    useNeighborList = false;
+    neighborSkin = 0.2f * h;
+    cellOrder = CellOrder::Linear;
+    cellsPerRadius = 1;
+    simdLevel = detectSimdLevel();
+    halfStencil = false;
+    workStealing = true;
+    pinThreads = false;
+    continuityDensity = false;
+    densityReinitInterval = 20;
+    incrementalSort = true;
+    fullSortInterval = 0;
+    adaptiveTimeStep = false;
+    cflFactor = 0.4f;
+    forceFactor = 0.25f;
+    viscousFactor = 0.125f;
+    minTimeStep = 0.0001f;
+    maxTimeStep = 0.01f;
+    frameBudget = 0.0f;
+    instanceAttribute = InstanceAttribute::None;
+    sphereScale = glm::scale(glm::mat4(1.0),glm::vec3(h/2.f)); //scale matrix for rendering
+}
@@ -0,0 +1,74 @@
+#ifndef SPH_SETTINGS_H
+#define SPH_SETTINGS_H
+
+#include <glm/glm.hpp>
+#include "neighborGrid.h"
+#include "sphSimd.h"
+
+/// Per-particle scalar that is handed to the renderer with the positions.
+enum class InstanceAttribute
+{
+    None,
+    Density,
+    Pressure,
+    Speed,
+};
+
+struct SPHSettings
+{
+    SPHSettings(
+        float mass, float restDensity, float gasConstant, float viscosity,
+        float h, float g, float tension);
+
+    glm::mat4 sphereScale;
+    float poly6, spikyGrad, spikyLap, gasConstant, mass, h2, selfDens,
+        restDensity, viscosity, h, g, tension, massPoly6Product;
+
+    // CPU neighbour search: Verlet lists of radius h + neighborSkin that
+    // are reused until a particle moved more than half the skin
+    bool useNeighborList;
+    float neighborSkin;
+    // memory order of the particles, see CellOrder
+    CellOrder cellOrder;
+    // grid cells per search radius (h, or h + neighborSkin for the lists):
+    // 1 searches the 27 cells around a particle, 2 the 125 of half the
+    // width, which hold fewer candidates beyond the radius; see
+    // CellStencil
+    int cellsPerRadius;
+    // instruction set of the grid density and force kernels, defaults to
+    // the widest one the CPU supports
+    SimdLevel simdLevel;
+    // grid force pass over half of the neighbour cells, applying every
+    // pair to both particles; scalar, takes precedence over simdLevel
+    bool halfStencil;
+    // density, force and integration passes on cell ranges of about equal
+    // neighbour counts that idle workers steal; off splits the particles
+    // into one equal block per worker
+    bool workStealing;
+    // evolves the density with the continuity equation, its rate summed
+    // in the force pass, so a step traverses the neighbours once; the
+    // densities are summed instead on the first step and then every
+    // densityReinitInterval steps (0: never again)
+    bool continuityDensity;
+    int densityReinitInterval;
+    // re-sorts only the particles that changed cell since the last sort,
+    // with a full sort every fullSortInterval sorts (0: only when too
+    // many moved); same order either way
+    bool incrementalSort;
+    int fullSortInterval;
+    // binds every worker thread to one CPU, node by node; the particles
+    // are moved to the nodes of their new workers when this changes
+    bool pinThreads;
+    // adaptive time step: the CFL, force and viscous limits scaled by
+    // their factors, clamped to [minTimeStep, maxTimeStep]; the caller's
+    // fixed step is used when off
+    bool adaptiveTimeStep;
+    float cflFactor, forceFactor, viscousFactor, minTimeStep, maxTimeStep;
+    // wall-clock seconds of sub-steps between two snapshots of the
+    // simulation thread, 0 takes a single step
+    float frameBudget;
+    // scalar of every particle the spheres are colored by
+    InstanceAttribute instanceAttribute;
+};
+
+#endif // SPH_SETTINGS_H
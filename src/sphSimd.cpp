@@ -0,0 +1,134 @@
+#include <cstring>
+#include "sphSimd.h"
+
+#ifdef SPH_SIMD_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+// Defined in the translation units built for each instruction set
+extern const SimdKernels SSE_KERNELS;
+extern const SimdKernels AVX2_KERNELS;
+extern const SimdKernels AVX512_KERNELS;
+
+namespace {
+void cpuid(int leaf, int subleaf, unsigned int regs[4])
+{
+#ifdef _MSC_VER
+    int values[4];
+    __cpuidex(values, leaf, subleaf);
+    for (int i = 0; i < 4; i++) {
+        regs[i] = unsigned(values[i]);
+    }
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Register state the OS saves on context switches
+uint64_t enabledStateMask()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (uint64_t(edx) << 32) | eax;
+#endif
+}
+}
+
+SimdLevel detectSimdLevel()
+{
+    unsigned int regs[4];
+    cpuid(0, 0, regs);
+    const unsigned int maxLeaf = regs[0];
+
+    cpuid(1, 0, regs);
+    const bool sse2 = (regs[3] & (1u << 26)) != 0;
+    const bool osxsave = (regs[2] & (1u << 27)) != 0;
+    const bool avx = (regs[2] & (1u << 28)) != 0;
+    const bool fma = (regs[2] & (1u << 12)) != 0;
+    if (!sse2) {
+        return SimdLevel::Scalar;
+    }
+    if (!osxsave || !avx || maxLeaf < 7) {
+        return SimdLevel::Sse;
+    }
+
+    // xmm and ymm state, plus opmask and zmm state for AVX-512
+    const uint64_t stateMask = enabledStateMask();
+    const bool ymmEnabled = (stateMask & 0x6) == 0x6;
+    const bool zmmEnabled = (stateMask & 0xe6) == 0xe6;
+
+    cpuid(7, 0, regs);
+    const bool avx2 = (regs[1] & (1u << 5)) != 0;
+    const bool avx512f = (regs[1] & (1u << 16)) != 0;
+    if (avx512f && zmmEnabled) {
+        return SimdLevel::Avx512;
+    }
+    if (avx2 && fma && ymmEnabled) {
+        return SimdLevel::Avx2;
+    }
+    return SimdLevel::Sse;
+}
+
+const SimdKernels *getSimdKernels(SimdLevel level)
+{
+    static const SimdLevel supported = detectSimdLevel();
+    if (level > supported) {
+        return nullptr;
+    }
+    switch (level) {
+    case SimdLevel::Sse:
+        return &SSE_KERNELS;
+    case SimdLevel::Avx2:
+        return &AVX2_KERNELS;
+    case SimdLevel::Avx512:
+        return &AVX512_KERNELS;
+    default:
+        return nullptr;
+    }
+}
+
+#else
+
+SimdLevel detectSimdLevel()
+{
+    return SimdLevel::Scalar;
+}
+
+const SimdKernels *getSimdKernels(SimdLevel)
+{
+    return nullptr;
+}
+
+#endif
+
+const char *getSimdLevelName(SimdLevel level)
+{
+    switch (level) {
+    case SimdLevel::Sse:
+        return "SSE";
+    case SimdLevel::Avx2:
+        return "AVX2";
+    case SimdLevel::Avx512:
+        return "AVX-512";
+    default:
+        return "scalar";
+    }
+}
+
+bool parseSimdLevel(const char *name, SimdLevel &level)
+{
+    const char *names[] = {"scalar", "sse", "avx2", "avx512"};
+    for (int i = 0; i < 4; i++) {
+        if (std::strcmp(name, names[i]) == 0) {
+            level = SimdLevel(i);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,81 @@
+#ifndef SPH_SIMD_H
+#define SPH_SIMD_H
+
+#include <cstdint>
+#include "sphParticles.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SPH_SIMD_X86 1
+#endif
+
+/// Instruction sets of the density and force kernels, ascending.
+enum class SimdLevel
+{
+    Scalar,
+    Sse,
+    Avx2,
+    Avx512,
+};
+
+/// Widest level the CPU and the OS support.
+SimdLevel detectSimdLevel();
+const char *getSimdLevelName(SimdLevel level);
+/// Parses "scalar", "sse", "avx2" or "avx512", returns false otherwise.
+bool parseSimdLevel(const char *name, SimdLevel &level);
+
+/// Contiguous range [start, end) of sorted particles, e.g. the particles
+/// of one or several neighbouring cells.
+struct ParticleRun
+{
+    uint32_t start;
+    uint32_t end;
+};
+
+/// Constants of the density and force kernels, folded from SPHSettings.
+struct SimdKernelParams
+{
+    float h;
+    float h2;
+    float massPoly6;
+    float gasConstant;
+    float restDensity;
+    // -mass * spikyGrad / 2
+    float pressureCoef;
+    // viscosity * mass * spikyLap
+    float viscosityCoef;
+    // -6 * mass * poly6, of the poly6 gradient
+    float densityRateCoef;
+};
+
+/// \struct SimdKernels
+///
+/// Density and force kernels of one instruction set. Both take the
+/// particles [start, end) of one cell and the candidate runs of its
+/// stencil, and test WIDTH candidates per instruction. The runs contain
+/// the particles themselves; a particle's own lane makes up its self
+/// density and is masked out of the forces.
+///
+/// Every instruction set lives in its own translation unit compiled for
+/// it, which only sees plain types, so no inline function built with wide
+/// instructions can leak into the code that runs on any CPU.
+struct SimdKernels
+{
+    /// Writes density and pressure, returns the neighbour pair count.
+    uint64_t (*densityAndPressures)(
+        ParticleData &particles, uint32_t start, uint32_t end,
+        const ParticleRun *runs, int runCount, const SimdKernelParams &params);
+    void (*forces)(
+        ParticleData &particles, uint32_t start, uint32_t end,
+        const ParticleRun *runs, int runCount, const SimdKernelParams &params);
+    /// Same, also writes the density rate of the continuity equation.
+    void (*forcesAndDensityRate)(
+        ParticleData &particles, uint32_t start, uint32_t end,
+        const ParticleRun *runs, int runCount, const SimdKernelParams &params);
+    int width;
+};
+
+/// Kernels of the given level, or nullptr for Scalar and for levels this
+/// CPU or build does not support.
+const SimdKernels *getSimdKernels(SimdLevel level);
+
+#endif // SPH_SIMD_H
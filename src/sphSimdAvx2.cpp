@@ -0,0 +1,59 @@
+#include "sphSimd.h"
+
+#ifdef SPH_SIMD_X86
+#include <immintrin.h>
+
+namespace {
+// AVX2 with FMA; built with -mavx2 -mfma outside MSVC
+struct Avx2Vector
+{
+    using Float = __m256;
+    using Mask = __m256;
+    static const int WIDTH = 8;
+
+    static Float zero() { return _mm256_setzero_ps(); }
+    static Float set1(float value) { return _mm256_set1_ps(value); }
+    static Float load(const float *values) { return _mm256_loadu_ps(values); }
+    static Float loadPartial(const float *values, int count, float fill)
+    {
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(count), lanes);
+        return _mm256_blendv_ps(
+            _mm256_set1_ps(fill), _mm256_loadu_ps(values),
+            _mm256_castsi256_ps(valid));
+    }
+    static Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+    static Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+    static Float div(Float a, Float b) { return _mm256_div_ps(a, b); }
+    static Float sqrt(Float a) { return _mm256_sqrt_ps(a); }
+    static Float fmadd(Float a, Float b, Float c) { return _mm256_fmadd_ps(a, b, c); }
+    static Mask less(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static Mask greater(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static Mask both(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+    static Float select(Mask mask, Float value) { return _mm256_and_ps(mask, value); }
+    static int countMask(Mask mask);
+    static float reduceAdd(Float a)
+    {
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+        __m128 pairs = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+    }
+};
+}
+
+#include "sphSimdKernels.inl"
+
+int Avx2Vector::countMask(Mask mask)
+{
+    return countBits(unsigned(_mm256_movemask_ps(mask)));
+}
+
+extern const SimdKernels AVX2_KERNELS = {
+    simdDensityAndPressures<Avx2Vector>,
+    simdForces<Avx2Vector, false>,
+    simdForces<Avx2Vector, true>,
+    Avx2Vector::WIDTH,
+};
+
+#endif
@@ -0,0 +1,51 @@
+#include "sphSimd.h"
+
+#ifdef SPH_SIMD_X86
+#include <immintrin.h>
+
+namespace {
+// AVX-512F; built with -mavx512f outside MSVC
+struct Avx512Vector
+{
+    using Float = __m512;
+    using Mask = __mmask16;
+    static const int WIDTH = 16;
+
+    static Float zero() { return _mm512_setzero_ps(); }
+    static Float set1(float value) { return _mm512_set1_ps(value); }
+    static Float load(const float *values) { return _mm512_loadu_ps(values); }
+    static Float loadPartial(const float *values, int count, float fill)
+    {
+        __mmask16 loadMask = __mmask16((1u << count) - 1);
+        return _mm512_mask_loadu_ps(_mm512_set1_ps(fill), loadMask, values);
+    }
+    static Float add(Float a, Float b) { return _mm512_add_ps(a, b); }
+    static Float sub(Float a, Float b) { return _mm512_sub_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm512_mul_ps(a, b); }
+    static Float div(Float a, Float b) { return _mm512_div_ps(a, b); }
+    static Float sqrt(Float a) { return _mm512_sqrt_ps(a); }
+    static Float fmadd(Float a, Float b, Float c) { return _mm512_fmadd_ps(a, b, c); }
+    static Mask less(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static Mask greater(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    static Mask both(Mask a, Mask b) { return Mask(a & b); }
+    static Float select(Mask mask, Float value) { return _mm512_maskz_mov_ps(mask, value); }
+    static int countMask(Mask mask);
+    static float reduceAdd(Float a) { return _mm512_reduce_add_ps(a); }
+};
+}
+
+#include "sphSimdKernels.inl"
+
+int Avx512Vector::countMask(Mask mask)
+{
+    return countBits(unsigned(mask));
+}
+
+extern const SimdKernels AVX512_KERNELS = {
+    simdDensityAndPressures<Avx512Vector>,
+    simdForces<Avx512Vector, false>,
+    simdForces<Avx512Vector, true>,
+    Avx512Vector::WIDTH,
+};
+
+#endif
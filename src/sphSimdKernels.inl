@@ -0,0 +1,197 @@
+// Density and force kernels written against a vector type V, included by
+// every sphSimd<ISA>.cpp after it defined V for its instruction set.
+//
+// V provides Float and Mask, WIDTH, zero, set1, load, loadPartial (lanes
+// past the count take a fill value; the load may read up to
+// ParticleData::PADDING elements past the end of a run), add, sub, mul,
+// div, sqrt, fmadd, less, greater, both (mask and), select (value where
+// the mask is set, zero elsewhere), countMask and reduceAdd.
+
+namespace {
+
+// Fill value for the position lanes past the end of a run, far enough
+// that their squared distance overflows and fails every range test
+const float FAR_AWAY = 1e30f;
+
+template <class V>
+uint64_t simdDensityAndPressures(
+    ParticleData &particles, uint32_t start, uint32_t end,
+    const ParticleRun *runs, int runCount, const SimdKernelParams &params)
+{
+    using Float = typename V::Float;
+    using Mask = typename V::Mask;
+    const float *posX = particles.posX;
+    const float *posY = particles.posY;
+    const float *posZ = particles.posZ;
+    const Float h2 = V::set1(params.h2);
+    uint64_t neighborPairs = 0;
+
+    for (uint32_t piIndex = start; piIndex < end; piIndex++) {
+        const Float xi = V::set1(posX[piIndex]);
+        const Float yi = V::set1(posY[piIndex]);
+        const Float zi = V::set1(posZ[piIndex]);
+        Float sum = V::zero();
+        int neighbors = 0;
+
+        // (h^2 - r^2)^3 of every candidate in range, including the
+        // particle itself, which adds exactly the self density
+        auto accumulate = [&](Float xj, Float yj, Float zj) {
+            Float dx = V::sub(xj, xi);
+            Float dy = V::sub(yj, yi);
+            Float dz = V::sub(zj, zi);
+            Float dist2 = V::fmadd(dz, dz, V::fmadd(dy, dy, V::mul(dx, dx)));
+            Mask inRange = V::less(dist2, h2);
+            Float t = V::sub(h2, dist2);
+            sum = V::add(sum, V::select(inRange, V::mul(V::mul(t, t), t)));
+            neighbors += V::countMask(inRange);
+        };
+
+        for (int r = 0; r < runCount; r++) {
+            uint32_t pjIndex = runs[r].start;
+            const uint32_t runEnd = runs[r].end;
+            for (; pjIndex + V::WIDTH <= runEnd; pjIndex += V::WIDTH) {
+                accumulate(
+                    V::load(posX + pjIndex), V::load(posY + pjIndex),
+                    V::load(posZ + pjIndex));
+            }
+            if (pjIndex < runEnd) {
+                int count = int(runEnd - pjIndex);
+                accumulate(
+                    V::loadPartial(posX + pjIndex, count, FAR_AWAY),
+                    V::loadPartial(posY + pjIndex, count, FAR_AWAY),
+                    V::loadPartial(posZ + pjIndex, count, FAR_AWAY));
+            }
+        }
+
+        float density = params.massPoly6 * V::reduceAdd(sum);
+        particles.density[piIndex] = density;
+        particles.pressure[piIndex]
+            = params.gasConstant * (density - params.restDensity);
+        particles.neighborCount[piIndex] = uint32_t(neighbors - 1);
+        neighborPairs += uint64_t(neighbors - 1);
+    }
+    return neighborPairs;
+}
+
+// DENSITY_RATE also sums m (vi - vj) . grad Wij with the gradient of the
+// poly6 kernel of the density pass, -6 poly6 (h^2 - r^2)^2 (ri - rj)
+template <class V, bool DENSITY_RATE>
+void simdForces(
+    ParticleData &particles, uint32_t start, uint32_t end,
+    const ParticleRun *runs, int runCount, const SimdKernelParams &params)
+{
+    using Float = typename V::Float;
+    using Mask = typename V::Mask;
+    const float *posX = particles.posX;
+    const float *posY = particles.posY;
+    const float *posZ = particles.posZ;
+    const float *velX = particles.velX;
+    const float *velY = particles.velY;
+    const float *velZ = particles.velZ;
+    const float *pressure = particles.pressure;
+    const float *density = particles.density;
+    const Float h = V::set1(params.h);
+    const Float h2 = V::set1(params.h2);
+    const Float zero = V::zero();
+    const Float pressureCoef = V::set1(params.pressureCoef);
+    const Float viscosityCoef = V::set1(params.viscosityCoef);
+
+    for (uint32_t piIndex = start; piIndex < end; piIndex++) {
+        const Float xi = V::set1(posX[piIndex]);
+        const Float yi = V::set1(posY[piIndex]);
+        const Float zi = V::set1(posZ[piIndex]);
+        const Float vxi = V::set1(velX[piIndex]);
+        const Float vyi = V::set1(velY[piIndex]);
+        const Float vzi = V::set1(velZ[piIndex]);
+        const Float piPressure = V::set1(pressure[piIndex]);
+        Float fx = V::zero();
+        Float fy = V::zero();
+        Float fz = V::zero();
+        Float rate = V::zero();
+
+        // Same pair force as the scalar kernel, with the direction folded
+        // into one coefficient per pair:
+        //   offset * pressureCoef * (pi + pj) / rhoj * (h - r)^2 / r
+        //   + dv * viscosityCoef * (h - r) / rhoj
+        // The own lane has r = 0 and is masked out with every lane beyond
+        // the support radius.
+        auto accumulate = [&](
+            Float xj, Float yj, Float zj, Float vxj, Float vyj, Float vzj,
+            Float pjPressure, Float pjDensity) {
+            Float dx = V::sub(xj, xi);
+            Float dy = V::sub(yj, yi);
+            Float dz = V::sub(zj, zi);
+            Float dist2 = V::fmadd(dz, dz, V::fmadd(dy, dy, V::mul(dx, dx)));
+            Mask inRange = V::both(V::less(dist2, h2), V::greater(dist2, zero));
+            Float dist = V::sqrt(dist2);
+            Float falloff = V::sub(h, dist);
+            Float invDensity = V::div(V::set1(1.0f), pjDensity);
+
+            Float pressureScale = V::mul(
+                V::mul(pressureCoef, V::add(piPressure, pjPressure)),
+                V::mul(invDensity, V::div(V::mul(falloff, falloff), dist)));
+            Float viscosityScale
+                = V::mul(V::mul(viscosityCoef, falloff), invDensity);
+            pressureScale = V::select(inRange, pressureScale);
+            viscosityScale = V::select(inRange, viscosityScale);
+
+            Float dvx = V::sub(vxj, vxi);
+            Float dvy = V::sub(vyj, vyi);
+            Float dvz = V::sub(vzj, vzi);
+            fx = V::fmadd(dx, pressureScale, fx);
+            fy = V::fmadd(dy, pressureScale, fy);
+            fz = V::fmadd(dz, pressureScale, fz);
+            fx = V::fmadd(dvx, viscosityScale, fx);
+            fy = V::fmadd(dvy, viscosityScale, fy);
+            fz = V::fmadd(dvz, viscosityScale, fz);
+            if (DENSITY_RATE) {
+                Float t = V::select(inRange, V::sub(h2, dist2));
+                Float approach = V::fmadd(dvz, dz, V::fmadd(dvy, dy, V::mul(dvx, dx)));
+                rate = V::fmadd(V::mul(t, t), approach, rate);
+            }
+        };
+
+        for (int r = 0; r < runCount; r++) {
+            uint32_t pjIndex = runs[r].start;
+            const uint32_t runEnd = runs[r].end;
+            for (; pjIndex + V::WIDTH <= runEnd; pjIndex += V::WIDTH) {
+                accumulate(
+                    V::load(posX + pjIndex), V::load(posY + pjIndex),
+                    V::load(posZ + pjIndex), V::load(velX + pjIndex),
+                    V::load(velY + pjIndex), V::load(velZ + pjIndex),
+                    V::load(pressure + pjIndex), V::load(density + pjIndex));
+            }
+            if (pjIndex < runEnd) {
+                int count = int(runEnd - pjIndex);
+                accumulate(
+                    V::loadPartial(posX + pjIndex, count, FAR_AWAY),
+                    V::loadPartial(posY + pjIndex, count, FAR_AWAY),
+                    V::loadPartial(posZ + pjIndex, count, FAR_AWAY),
+                    V::loadPartial(velX + pjIndex, count, 0.0f),
+                    V::loadPartial(velY + pjIndex, count, 0.0f),
+                    V::loadPartial(velZ + pjIndex, count, 0.0f),
+                    V::loadPartial(pressure + pjIndex, count, 0.0f),
+                    V::loadPartial(density + pjIndex, count, 1.0f));
+            }
+        }
+
+        particles.forceX[piIndex] = V::reduceAdd(fx);
+        particles.forceY[piIndex] = V::reduceAdd(fy);
+        particles.forceZ[piIndex] = V::reduceAdd(fz);
+        if (DENSITY_RATE) {
+            particles.densityRate[piIndex] = params.densityRateCoef * V::reduceAdd(rate);
+        }
+    }
+}
+
+inline int countBits(unsigned int bits)
+{
+    int count = 0;
+    while (bits != 0) {
+        bits &= bits - 1;
+        count++;
+    }
+    return count;
+}
+
+}
@@ -0,0 +1,59 @@
+#include "sphSimd.h"
+
+#ifdef SPH_SIMD_X86
+#include <emmintrin.h>
+
+namespace {
+// SSE2, part of every x86-64 CPU
+struct SseVector
+{
+    using Float = __m128;
+    using Mask = __m128;
+    static const int WIDTH = 4;
+
+    static Float zero() { return _mm_setzero_ps(); }
+    static Float set1(float value) { return _mm_set1_ps(value); }
+    static Float load(const float *values) { return _mm_loadu_ps(values); }
+    static Float loadPartial(const float *values, int count, float fill)
+    {
+        const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+        Float valid = _mm_castsi128_ps(_mm_cmplt_epi32(lanes, _mm_set1_epi32(count)));
+        return _mm_or_ps(
+            _mm_and_ps(valid, _mm_loadu_ps(values)),
+            _mm_andnot_ps(valid, _mm_set1_ps(fill)));
+    }
+    static Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+    static Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+    static Float div(Float a, Float b) { return _mm_div_ps(a, b); }
+    static Float sqrt(Float a) { return _mm_sqrt_ps(a); }
+    static Float fmadd(Float a, Float b, Float c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static Mask less(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+    static Mask greater(Float a, Float b) { return _mm_cmpgt_ps(a, b); }
+    static Mask both(Mask a, Mask b) { return _mm_and_ps(a, b); }
+    static Float select(Mask mask, Float value) { return _mm_and_ps(mask, value); }
+    static int countMask(Mask mask);
+    static float reduceAdd(Float a)
+    {
+        Float pairs = _mm_add_ps(a, _mm_movehl_ps(a, a));
+        Float sum = _mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1));
+        return _mm_cvtss_f32(sum);
+    }
+};
+}
+
+#include "sphSimdKernels.inl"
+
+int SseVector::countMask(Mask mask)
+{
+    return countBits(unsigned(_mm_movemask_ps(mask)));
+}
+
+extern const SimdKernels SSE_KERNELS = {
+    simdDensityAndPressures<SseVector>,
+    simdForces<SseVector, false>,
+    simdForces<SseVector, true>,
+    SseVector::WIDTH,
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include "sphSimulation.h"
+
+SphSimulation::SphSimulation(
+    size_t particleCubeWidth, const SPHSettings &settings, bool runOnGPU,
+    size_t threadCount):
+    settings(settings),
+    particleCubeWidth(particleCubeWidth),
+    runOnGPU(runOnGPU),
+    topology(CpuTopology::detect()),
+    threadPool(threadCount),
+    threadIdleTimes(threadPool.size(), 0.0)
+{
+    size_t particleCount = particleCubeWidth * particleCubeWidth * particleCubeWidth;
+    particles.allocate(particleCount);
+    sortBuffer.allocate(particleCount);
+    reset();
+}
+
+void SphSimulation::reset()
+{
+    //initializes a 3D grid of particles
+    /*
+        Places particles in a cubic arrangement.
+        Introduces slight random offsets to particle positions to prevent numerical artifacts from perfect grid alignment.
+        Initializes particle velocities to zero.
+    */
+	std::srand(1024);
+	float particleSeperation = settings.h + 0.01f;
+	for (int i = 0; i < particleCubeWidth; i++) {
+		for (int j = 0; j < particleCubeWidth; j++) {
+			for (int k = 0; k < particleCubeWidth; k++) {
+				float ranX = (float(rand()) / float((RAND_MAX)) * 0.5f - 1) * settings.h / 10;
+				float ranY = (float(rand()) / float((RAND_MAX)) * 0.5f - 1) * settings.h / 10;
+				float ranZ = (float(rand()) / float((RAND_MAX)) * 0.5f - 1) * settings.h / 10;
+				glm::vec3 nParticlePos = glm::vec3(
+                    i * particleSeperation + ranX - 1.5f,
+                    j * particleSeperation + ranY + settings.h + 0.1f,
+                    k * particleSeperation + ranZ - 1.5f);
+
+                size_t particleIndex = i + (j + particleCubeWidth * k) * particleCubeWidth;
+                particles.posX[particleIndex] = nParticlePos.x;
+                particles.posY[particleIndex] = nParticlePos.y;
+                particles.posZ[particleIndex] = nParticlePos.z;
+                particles.velX[particleIndex] = 0.0f;
+                particles.velY[particleIndex] = 0.0f;
+                particles.velZ[particleIndex] = 0.0f;
+			}
+		}
+	}
+
+	// the old cell domain and neighbour lists describe the old particles
+	grid.clearDomain();
+	neighborList.invalidate();
+	continuity.invalidate();
+	stepCount = 0;
+	lastTimeStep = 0.0f;
+	// at rest, only gravity accelerates
+	motionBounds.maxSpeed = 0.0f;
+	motionBounds.maxAcceleration = std::fabs(settings.g);
+}
+
+float SphSimulation::step(float deltaTime)
+{
+    if (!particlesPlaced || settings.pinThreads != pinRequested) {
+        placeParticles();
+    }
+    if (settings.adaptiveTimeStep) {
+        deltaTime = getAdaptiveTimeStep(settings, motionBounds);
+    }
+    threadPool.resetIdleTimes();
+    updateParticles(
+        threadPool, sorter, grid, neighborList, tasks, particles,
+        sortBuffer, settings, deltaTime, runOnGPU, neighborStats, motionBounds,
+        continuity);
+    threadIdleTimes = threadPool.getIdleTimes();
+    lastTimeStep = deltaTime;
+    stepCount++;
+    return deltaTime;
+}
+
+void SphSimulation::placeParticles()
+{
+    // Pages go to the node of the thread that first touches them, so the
+    // workers move first
+    pinRequested = settings.pinThreads;
+    threadsPinned = threadPool.setAffinity(topology.getPinOrder(), pinRequested)
+        && pinRequested;
+
+    sortBuffer.allocate(threadPool, particles.count);
+    threadPool.parallelFor(particles.count, [&](size_t start, size_t end) {
+        sortBuffer.copyRange(particles, start, end);
+    });
+    particles.swap(sortBuffer);
+    sortBuffer.allocate(threadPool, particles.count);
+    particlesPlaced = true;
+}
+
+float SphSimulation::stepFor(double budgetSeconds, float deltaTime)
+{
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+    float simulatedTime = 0.0f;
+    double elapsed = 0.0;
+    double longestStep = 0.0;
+    // Stop before a step like the longest so far would overrun the budget
+    do {
+        simulatedTime += step(deltaTime);
+        double now = std::chrono::duration<double>(Clock::now() - start).count();
+        longestStep = std::max(longestStep, now - elapsed);
+        elapsed = now;
+    } while (elapsed + longestStep <= budgetSeconds);
+    return simulatedTime;
+}
+
+glm::vec2 SphSimulation::writeInstances(ParticleInstance *instances)
+{
+    return computeInstances(threadPool, particles, settings, instances);
+}
+
+void SphSimulation::extractSurface(const SurfaceSettings &surface, SurfaceMesh &mesh)
+{
+    // The cell runs of the grid index the particles in the order of the
+    // last step's sort, which a reset discards
+    if (stepCount == 0) {
+        mesh.positions.clear();
+        mesh.normals.clear();
+        mesh.indices.clear();
+        return;
+    }
+    surfaceExtractor.extract(threadPool, particles, grid, settings, surface, mesh);
+}
@@ -0,0 +1,112 @@
+#ifndef SPH_SIMULATION_H
+#define SPH_SIMULATION_H
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+#include "cpuTopology.h"
+#include "threadPool.h"
+#include "sphParticles.h"
+#include "sphSettings.h"
+#include "radixSort.h"
+#include "neighborGrid.h"
+#include "neighborList.h"
+#include "sphCalculation.h"
+#include "surfaceExtractor.h"
+
+/// \class SphSimulation
+///
+/// The particles of one simulation together with the workers and scratch
+/// every step reuses, without anything tied to rendering. SphSystem draws
+/// it through a SimulationThread, sph_headless runs it without a window or
+/// GL context.
+class SphSimulation
+{
+public:
+    SphSimulation(
+        size_t particleCubeWidth, const SPHSettings &settings,
+        bool runOnGPU = false,
+        size_t threadCount = std::thread::hardware_concurrency());
+
+    /// Places the particles on the initial jittered cube, at rest.
+    void reset();
+    /// Advances the simulation by one step and returns its length: the
+    /// adaptive time step with settings.adaptiveTimeStep, else deltaTime.
+    float step(float deltaTime);
+    /// Repeats step() until budgetSeconds of wall-clock time passed, at
+    /// least once, and returns the simulated time.
+    float stepFor(double budgetSeconds, float deltaTime);
+
+    SPHSettings &getSettings() { return settings; }
+    const SPHSettings &getSettings() const { return settings; }
+    const ParticleData &getParticles() const { return particles; }
+    size_t getParticleCount() const { return particles.count; }
+    /// Writes the instance data of every particle for rendering and
+    /// returns the range of their values. Only built on request, a step
+    /// never writes them.
+    glm::vec2 writeInstances(ParticleInstance *instances);
+    /// Marching cubes surface of the particles as of the last step, empty
+    /// until the first step after a reset. The extractor's buffers are
+    /// kept for the next call.
+    void extractSurface(const SurfaceSettings &surface, SurfaceMesh &mesh);
+    const SurfaceExtractor &getSurfaceExtractor() const { return surfaceExtractor; }
+    /// Pair counts of the last step's neighbour search.
+    const NeighborStats &getNeighborStats() const { return neighborStats; }
+    /// Largest speed and acceleration of the last step.
+    const MotionBounds &getMotionBounds() const { return motionBounds; }
+    /// Seconds every worker idled at the ends of the last step's phases.
+    const std::vector<double> &getThreadIdleTimes() const { return threadIdleTimes; }
+    /// Length of the last step.
+    float getLastTimeStep() const { return lastTimeStep; }
+    /// Steps since the last reset.
+    uint64_t getStepCount() const { return stepCount; }
+    size_t getThreadCount() const { return threadPool.size(); }
+    /// NUMA nodes and CPUs found at construction.
+    const CpuTopology &getTopology() const { return topology; }
+    /// Whether the workers are bound to their CPUs, as of the last step.
+    bool areThreadsPinned() const { return threadsPinned; }
+
+private:
+    /// Applies settings.pinThreads to the workers and moves the particles
+    /// into arrays first touched by them, so every worker's block sits on
+    /// its own NUMA node. Runs on the stepping thread, which is worker 0.
+    void placeParticles();
+
+    SPHSettings settings;
+    size_t particleCubeWidth;
+    bool runOnGPU;
+
+    ParticleData particles;
+    // gather target of the per-step sort, swapped with particles
+    ParticleData sortBuffer;
+
+    CpuTopology topology;
+    // workers shared by every CPU phase, kept alive for the whole run
+    ThreadPool threadPool;
+    // settings.pinThreads the particles were last placed for
+    bool particlesPlaced{false};
+    bool pinRequested{false};
+    bool threadsPinned{false};
+    // radix sort scratch, reused by every step
+    RadixSorter sorter;
+    // cell ranges of the sorted particles, rebuilt in place every step
+    NeighborGrid grid;
+    // Verlet lists, only used with settings.useNeighborList
+    NeighborList neighborList;
+    // cost-balanced particle ranges of the per-particle passes
+    ParticleTasks tasks;
+    // pair counts of the last step's neighbour search
+    NeighborStats neighborStats;
+    // inputs of the next adaptive time step
+    MotionBounds motionBounds;
+    // age of the densities with settings.continuityDensity
+    ContinuityState continuity;
+    // marching cubes tables and scratch, see extractSurface
+    SurfaceExtractor surfaceExtractor;
+    std::vector<double> threadIdleTimes;
+    float lastTimeStep{0.0f};
+    uint64_t stepCount{0};
+};
+
+#endif // SPH_SIMULATION_H
@@ -2,56 +2,61 @@
 #define __SPHSYS_H__
 
 #include "model.h"
-#include "Timer.h"
-#include <thread>
-
-struct Particle
-{
-	glm::vec3 position, velocity, acceleration, force;
-    float density;
-    float pressure;
-    uint16_t hash;
-};
-
-struct SPHSettings
-{
-    SPHSettings(
-        float mass, float restDensity, float gasConstant, float viscosity,
-        float h, float g, float tension);
-
-    glm::mat4 sphereScale;
-    float poly6, spikyGrad, spikyLap, gasConstant, mass, h2, selfDens,
-        restDensity, viscosity, h, g, tension, massPoly6Product;
+#include "streamBuffer.h"
+#include "simulationThread.h"
+
+// How draw() renders the particles
+enum class ParticleRenderMode {
+    // one camera-facing quad per particle, ray cast into a sphere with
+    // per-fragment depth and normal (shader/impostor.*)
+    Impostor,
+    // one instanced lowsphere.obj mesh per particle (shader/particle.*)
+    Mesh,
+    // screen-space fluid surface; the context runs its passes, which draw
+    // the impostor quads with their own programs
+    Fluid,
 };
 
 class SphSystem {
 private:
+    // persistently mapped instance regions the snapshots are written into,
+    // declared first so it outlives the simulation thread
+    StreamBufferUPtr m_instanceBuffer;
+    // CPU simulation this system draws, stepping on its own thread
+    SimulationThread simulation;
+    // settings the UI edits, handed to the simulation every update
     SPHSettings settings;
-    size_t particleCubeWidth;
+    // snapshot taken by the last update(), drawn until the next one
+    const SimulationSnapshot *snapshot;
 
 	bool started;
-    bool runOnGPU;
-    BufferPtr m_vbo;
-	//initializes the particles that will be used
-	void initParticles();
+	ParticleRenderMode renderMode{ParticleRenderMode::Impostor};
+	// instance attribute only, the impostor corners come from gl_VertexID
+	VertexLayoutUPtr impostorLayout;
 
 	// Sphere geometry for rendering
-    glm::mat4* sphereModelMtxs;
     ModelUPtr sphere;
 
 public:
     SphSystem(size_t numParticles, const SPHSettings &settings, const bool &runOnGPU);
-	~SphSystem();
 
-	Particle* particles;
     size_t particleCount;
 
-	//updates the SPH system
+	//hands the settings and the fixed time step to the simulation thread
+	//and takes the latest snapshot the GPU may switch to, once per frame
 	void update(float deltaTime);
-    //draws the SPH system and particles
-	void draw(const glm::mat4& viewProjMtx, Program* shader);
+    //draws the particles of the current snapshot with the program of the
+    //render mode, may be called for several passes per frame
+	void draw(const glm::mat4& view, const glm::mat4& projection, Program* shader);
 
 	void reset();
 	void startSimulation();
+
+	const NeighborStats &getNeighborStats() const { return snapshot->neighborStats; }
+	const std::vector<double> &getThreadIdleTimes() const { return snapshot->threadIdleTimes; }
+	float getLastTimeStep() const { return snapshot->timeStep; }
+	uint64_t getStepCount() const { return snapshot->stepCount; }
+	SPHSettings &getSettings() { return settings; }
+	ParticleRenderMode &getRenderMode() { return renderMode; }
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "streamBuffer.h"
+
+StreamBufferUPtr StreamBuffer::Create(uint32_t bufferType, size_t stride, size_t count, size_t regionCount)
+{
+    auto buffer = StreamBufferUPtr(new StreamBuffer());
+    if (!buffer->Init(bufferType, stride, count, regionCount))
+    {
+        return nullptr;
+    }
+    return move(buffer);
+}
+
+StreamBuffer::~StreamBuffer()
+{
+    for (GLsync fence : m_fences)
+    {
+        if (fence)
+        {
+            glDeleteSync(fence);
+        }
+    }
+}
+
+void *StreamBuffer::GetRegion(size_t region) const
+{
+    return static_cast<uint8_t *>(m_buffer->GetMapped()) + region * m_count * m_buffer->GetStride();
+}
+
+void StreamBuffer::Fence(size_t region)
+{
+    if (m_fences[region])
+    {
+        glDeleteSync(m_fences[region]);
+    }
+    m_fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool StreamBuffer::IsRegionFree(size_t region)
+{
+    if (!m_fences[region])
+    {
+        return true;
+    }
+    GLenum result = glClientWaitSync(m_fences[region], 0, 0);
+    if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+    {
+        return false;
+    }
+    glDeleteSync(m_fences[region]);
+    m_fences[region] = nullptr;
+    return true;
+}
+
+bool StreamBuffer::Init(uint32_t bufferType, size_t stride, size_t count, size_t regionCount)
+{
+    m_buffer = Buffer::CreatePersistent(bufferType, stride, count * regionCount);
+    if (!m_buffer)
+    {
+        return false;
+    }
+    m_count = count;
+    m_fences.assign(regionCount, nullptr);
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef __STREAM_BUFFER_H__
+#define __STREAM_BUFFER_H__
+#include "buffer.h"
+#include <vector>
+
+CLASS_PTR(StreamBuffer);
+
+// Ring of equally sized regions in one persistently mapped buffer. The CPU
+// writes a region through its pointer, any thread may do so, while the GPU
+// reads another one; a fence after the draws of a region tells when the
+// GPU is done with it, so nothing is copied and the driver never has to
+// synchronize a map.
+class StreamBuffer
+{
+public:
+    static StreamBufferUPtr Create(uint32_t bufferType, size_t stride, size_t count, size_t regionCount = 3);
+    ~StreamBuffer();
+
+    const Buffer *GetBuffer() const { return m_buffer.get(); }
+    size_t GetRegionCount() const { return m_fences.size(); }
+    // elements per region
+    size_t GetCount() const { return m_count; }
+    // first element of the region in the whole buffer, e.g. the base instance
+    size_t GetRegionStart(size_t region) const { return region * m_count; }
+    void *GetRegion(size_t region) const;
+
+    // GL thread: marks the commands issued so far as the last readers of
+    // the region
+    void Fence(size_t region);
+    // GL thread: whether the GPU finished every command fenced on the
+    // region, never blocks
+    bool IsRegionFree(size_t region);
+
+private:
+    StreamBuffer() {}
+    bool Init(uint32_t bufferType, size_t stride, size_t count, size_t regionCount);
+    BufferUPtr m_buffer;
+    size_t m_count { 0 };
+    std::vector<GLsync> m_fences;
+};
+
+#endif
@@ -0,0 +1,296 @@
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+
+#include "surfaceExtractor.h"
+#include "profiler.h"
+
+namespace {
+#include "marchingCubesTables.inl"
+
+const uint32_t NO_VERTEX = UINT32_MAX;
+// voxel corners along one side of a block
+const int BLOCK_CORNERS = SurfaceExtractor::BLOCK_SIZE + 1;
+
+inline int cornerIndex(int x, int y, int z)
+{
+    return (z * BLOCK_CORNERS + y) * BLOCK_CORNERS + x;
+}
+}
+
+void SurfaceExtractor::extract(
+    ThreadPool &threadPool, const ParticleData &particles,
+    const NeighborGrid &grid, const SPHSettings &settings,
+    const SurfaceSettings &surface, SurfaceMesh &mesh)
+{
+    SPH_PROFILE_ZONE("surface");
+    const size_t threadCount = threadPool.size();
+    const size_t runCount = grid.getOccupiedCount();
+    const float radius = surface.radiusScale * settings.h;
+    activeBlocks.clear();
+    mesh.positions.clear();
+    mesh.normals.clear();
+    mesh.indices.clear();
+    if (runCount == 0 || surface.resolution < 1) {
+        return;
+    }
+
+    // Bounds of every run and of all particles
+    const uint32_t *occupiedCells = grid.getOccupiedCells();
+    const uint32_t *cellStarts = grid.getCellStarts();
+    const uint32_t *cellEnds = grid.getCellEnds();
+    runLower.resize(runCount);
+    runUpper.resize(runCount);
+    runStarts.resize(runCount);
+    runEnds.resize(runCount);
+    std::vector<glm::vec3> blockLower(threadCount, glm::vec3(FLT_MAX));
+    std::vector<glm::vec3> blockUpper(threadCount, glm::vec3(-FLT_MAX));
+    threadPool.run([&](size_t threadIndex, size_t threadCount) {
+        size_t start, end;
+        ThreadPool::blockRange(runCount, threadIndex, threadCount, start, end);
+        for (size_t run = start; run < end; run++) {
+            uint32_t key = occupiedCells[run];
+            glm::vec3 lower(FLT_MAX), upper(-FLT_MAX);
+            for (uint32_t i = cellStarts[key]; i < cellEnds[key]; i++) {
+                glm::vec3 position(particles.posX[i], particles.posY[i], particles.posZ[i]);
+                lower = glm::min(lower, position);
+                upper = glm::max(upper, position);
+            }
+            runStarts[run] = cellStarts[key];
+            runEnds[run] = cellEnds[key];
+            runLower[run] = lower;
+            runUpper[run] = upper;
+            blockLower[threadIndex] = glm::min(blockLower[threadIndex], lower);
+            blockUpper[threadIndex] = glm::max(blockUpper[threadIndex], upper);
+        }
+    });
+    glm::vec3 lower = blockLower[0], upper = blockUpper[0];
+    for (size_t t = 1; t < threadCount; t++) {
+        lower = glm::min(lower, blockLower[t]);
+        upper = glm::max(upper, blockUpper[t]);
+    }
+
+    // Voxel grid over the bounds grown by the splat radius
+    const glm::vec3 origin = lower - glm::vec3(radius);
+    const glm::vec3 extent = upper - lower + glm::vec3(2.0f * radius);
+    const float voxelSize
+        = std::max(extent.x, std::max(extent.y, extent.z)) / float(surface.resolution);
+    for (int axis = 0; axis < 3; axis++) {
+        voxelDims[axis] = std::max(1, int(std::ceil(extent[axis] / voxelSize)));
+        blockDims[axis] = (voxelDims[axis] + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+    binRuns(origin, voxelSize * BLOCK_SIZE, radius);
+
+    // Every worker takes the next block until none are left; the blocks
+    // differ a lot in cost
+    {
+        SPH_PROFILE_ZONE("surface blocks");
+        scratch.resize(threadCount);
+        std::atomic<size_t> nextBlock{0};
+        threadPool.run([&](size_t threadIndex, size_t threadCount) {
+            ThreadScratch &local = scratch[threadIndex];
+            local.field.resize(BLOCK_CORNERS * BLOCK_CORNERS * BLOCK_CORNERS);
+            local.edgeVertices.resize(local.field.size() * 3);
+            local.positions.clear();
+            local.normals.clear();
+            local.indices.clear();
+            for (size_t slot = nextBlock++; slot < activeBlocks.size(); slot = nextBlock++) {
+                extractBlock(
+                    particles, uint32_t(slot), origin, voxelSize, radius,
+                    surface.isoLevel, local);
+            }
+        });
+    }
+
+    // Concatenate the per-thread lists
+    SPH_PROFILE_ZONE("surface merge");
+    vertexOffsets.resize(threadCount + 1);
+    indexOffsets.resize(threadCount + 1);
+    vertexOffsets[0] = 0;
+    indexOffsets[0] = 0;
+    for (size_t t = 0; t < threadCount; t++) {
+        vertexOffsets[t + 1] = vertexOffsets[t] + scratch[t].positions.size();
+        indexOffsets[t + 1] = indexOffsets[t] + scratch[t].indices.size();
+    }
+    mesh.positions.resize(vertexOffsets[threadCount]);
+    mesh.normals.resize(vertexOffsets[threadCount]);
+    mesh.indices.resize(indexOffsets[threadCount]);
+    threadPool.run([&](size_t threadIndex, size_t threadCount) {
+        const ThreadScratch &local = scratch[threadIndex];
+        std::copy(local.positions.begin(), local.positions.end(),
+            mesh.positions.begin() + vertexOffsets[threadIndex]);
+        std::copy(local.normals.begin(), local.normals.end(),
+            mesh.normals.begin() + vertexOffsets[threadIndex]);
+        const uint32_t vertexOffset = uint32_t(vertexOffsets[threadIndex]);
+        uint32_t *indices = mesh.indices.data() + indexOffsets[threadIndex];
+        for (size_t i = 0; i < local.indices.size(); i++) {
+            indices[i] = local.indices[i] + vertexOffset;
+        }
+    });
+}
+
+void SurfaceExtractor::binRuns(const glm::vec3 &origin, float blockWidth, float radius)
+{
+    SPH_PROFILE_ZONE("surface bins");
+    const size_t blockCount = size_t(blockDims.x) * blockDims.y * blockDims.z;
+    if (blockStamps.size() < blockCount) {
+        blockStamps.resize(blockCount, 0);
+        blockSlots.resize(blockCount);
+    }
+    if (++stamp == 0) {
+        // wrapped around, older stamps could match again
+        std::fill(blockStamps.begin(), blockStamps.end(), 0);
+        stamp = 1;
+    }
+
+    // Two passes over the blocks every run reaches: count the runs of
+    // every block, then place them
+    const float invBlockWidth = 1.0f / blockWidth;
+    auto forEachBlock = [&](size_t run, auto &&visit) {
+        glm::ivec3 first, last;
+        for (int axis = 0; axis < 3; axis++) {
+            first[axis] = std::max(0,
+                int(std::floor((runLower[run][axis] - radius - origin[axis]) * invBlockWidth)));
+            last[axis] = std::min(blockDims[axis] - 1,
+                int(std::floor((runUpper[run][axis] + radius - origin[axis]) * invBlockWidth)));
+        }
+        for (int z = first.z; z <= last.z; z++) {
+            for (int y = first.y; y <= last.y; y++) {
+                for (int x = first.x; x <= last.x; x++) {
+                    visit(uint32_t((z * blockDims.y + y) * blockDims.x + x));
+                }
+            }
+        }
+    };
+
+    blockRunOffsets.clear();
+    for (size_t run = 0; run < runLower.size(); run++) {
+        forEachBlock(run, [&](uint32_t block) {
+            if (blockStamps[block] != stamp) {
+                blockStamps[block] = stamp;
+                blockSlots[block] = uint32_t(activeBlocks.size());
+                activeBlocks.push_back(block);
+                blockRunOffsets.push_back(0);
+            }
+            blockRunOffsets[blockSlots[block]]++;
+        });
+    }
+    uint32_t offset = 0;
+    for (uint32_t &count : blockRunOffsets) {
+        uint32_t blockRunCount = count;
+        count = offset;
+        offset += blockRunCount;
+    }
+    blockRunOffsets.push_back(offset);
+    blockRuns.resize(offset);
+    for (size_t run = 0; run < runLower.size(); run++) {
+        forEachBlock(run, [&](uint32_t block) {
+            blockRuns[blockRunOffsets[blockSlots[block]]++] = uint32_t(run);
+        });
+    }
+    // The placement advanced every offset to the start of the next block
+    for (size_t slot = blockRunOffsets.size() - 1; slot > 0; slot--) {
+        blockRunOffsets[slot] = blockRunOffsets[slot - 1];
+    }
+    blockRunOffsets[0] = 0;
+}
+
+void SurfaceExtractor::extractBlock(
+    const ParticleData &particles, uint32_t slot, const glm::vec3 &origin,
+    float voxelSize, float radius, float isoLevel, ThreadScratch &scratch)
+{
+    const uint32_t block = activeBlocks[slot];
+    const glm::ivec3 blockCell(
+        int(block % uint32_t(blockDims.x)),
+        int(block / uint32_t(blockDims.x) % uint32_t(blockDims.y)),
+        int(block / (uint32_t(blockDims.x) * uint32_t(blockDims.y))));
+    // Corners are placed from their global voxel index, so the blocks on
+    // either side of a face compute bitwise equal corners and vertices
+    const glm::ivec3 firstCorner = blockCell * BLOCK_SIZE;
+    const float invVoxelSize = 1.0f / voxelSize;
+    const float radius2 = radius * radius;
+    const float invRadius2 = 1.0f / radius2;
+
+    // Splat (1 - d^2/r^2)^3 and its gradient onto the voxel corners
+    std::vector<glm::vec4> &field = scratch.field;
+    std::fill(field.begin(), field.end(), glm::vec4(0.0f));
+    for (uint32_t r = blockRunOffsets[slot]; r < blockRunOffsets[slot + 1]; r++) {
+        const uint32_t run = blockRuns[r];
+        for (uint32_t i = runStarts[run]; i < runEnds[run]; i++) {
+            glm::vec3 position(particles.posX[i], particles.posY[i], particles.posZ[i]);
+            glm::vec3 local = (position - origin) * invVoxelSize;
+            // one corner of slack, the distance test has the last word
+            glm::ivec3 first, last;
+            for (int axis = 0; axis < 3; axis++) {
+                first[axis] = std::max(0,
+                    int(std::floor(local[axis] - radius * invVoxelSize)) - firstCorner[axis]);
+                last[axis] = std::min(BLOCK_SIZE,
+                    int(std::ceil(local[axis] + radius * invVoxelSize)) - firstCorner[axis]);
+            }
+            for (int z = first.z; z <= last.z; z++) {
+                for (int y = first.y; y <= last.y; y++) {
+                    for (int x = first.x; x <= last.x; x++) {
+                        glm::vec3 offset = origin
+                            + glm::vec3(firstCorner + glm::ivec3(x, y, z)) * voxelSize - position;
+                        float dist2 = glm::dot(offset, offset);
+                        if (dist2 >= radius2) {
+                            continue;
+                        }
+                        float falloff = 1.0f - dist2 * invRadius2;
+                        glm::vec4 &corner = field[cornerIndex(x, y, z)];
+                        corner.w += falloff * falloff * falloff;
+                        corner += glm::vec4(
+                            offset * (-6.0f * falloff * falloff * invRadius2), 0.0f);
+                    }
+                }
+            }
+        }
+    }
+
+    // March the cubes; edges shared inside the block share their vertex
+    std::fill(scratch.edgeVertices.begin(), scratch.edgeVertices.end(), NO_VERTEX);
+    for (int z = 0; z < BLOCK_SIZE; z++) {
+        for (int y = 0; y < BLOCK_SIZE; y++) {
+            for (int x = 0; x < BLOCK_SIZE; x++) {
+                int caseIndex = 0;
+                for (int c = 0; c < 8; c++) {
+                    const int *corner = CORNER_OFFSETS[c];
+                    if (field[cornerIndex(x + corner[0], y + corner[1], z + corner[2])].w > isoLevel) {
+                        caseIndex |= 1 << c;
+                    }
+                }
+                const int8_t *triangles = TRIANGLE_TABLE[caseIndex];
+                for (int t = 0; triangles[t] >= 0; t++) {
+                    const int *a = CORNER_OFFSETS[EDGE_CORNERS[triangles[t]][0]];
+                    const int *b = CORNER_OFFSETS[EDGE_CORNERS[triangles[t]][1]];
+                    // low corner first, so the cubes sharing the edge
+                    // interpolate it the same way
+                    glm::ivec3 cornerA(x + a[0], y + a[1], z + a[2]);
+                    glm::ivec3 cornerB(x + b[0], y + b[1], z + b[2]);
+                    if (a[0] + a[1] + a[2] > b[0] + b[1] + b[2]) {
+                        std::swap(cornerA, cornerB);
+                    }
+                    int axis = a[0] != b[0] ? 0 : (a[1] != b[1] ? 1 : 2);
+                    uint32_t &vertex = scratch.edgeVertices[
+                        cornerIndex(cornerA.x, cornerA.y, cornerA.z) * 3 + axis];
+                    if (vertex == NO_VERTEX) {
+                        const glm::vec4 &fieldA = field[cornerIndex(cornerA.x, cornerA.y, cornerA.z)];
+                        const glm::vec4 &fieldB = field[cornerIndex(cornerB.x, cornerB.y, cornerB.z)];
+                        float weight = (isoLevel - fieldA.w) / (fieldB.w - fieldA.w);
+                        glm::vec3 position = glm::mix(
+                            glm::vec3(firstCorner + cornerA), glm::vec3(firstCorner + cornerB), weight);
+                        // the field falls off outwards
+                        glm::vec3 gradient = glm::mix(glm::vec3(fieldA), glm::vec3(fieldB), weight);
+                        float length = glm::length(gradient);
+                        vertex = uint32_t(scratch.positions.size());
+                        scratch.positions.push_back(origin + position * voxelSize);
+                        scratch.normals.push_back(
+                            length > 0.0f ? -gradient / length : glm::vec3(0.0f, 1.0f, 0.0f));
+                    }
+                    scratch.indices.push_back(vertex);
+                }
+            }
+        }
+    }
+}
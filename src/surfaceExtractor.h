@@ -0,0 +1,103 @@
+#ifndef SPH_SURFACE_EXTRACTOR_H
+#define SPH_SURFACE_EXTRACTOR_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "threadPool.h"
+#include "sphParticles.h"
+#include "sphSettings.h"
+#include "neighborGrid.h"
+
+/// Resolution and shape of an extracted fluid surface.
+struct SurfaceSettings
+{
+    /// Voxels along the longest side of the particle bounds.
+    int resolution{256};
+    /// Splat radius in multiples of h.
+    float radiusScale{1.0f};
+    /// Field value on the surface; a lone particle reaches 1 at its center.
+    float isoLevel{0.5f};
+};
+
+/// Indexed triangle list with per-vertex normals, counter-clockwise seen
+/// from outside the fluid.
+struct SurfaceMesh
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<uint32_t> indices;
+};
+
+/// \class SurfaceExtractor
+///
+/// Marching cubes over a sparse voxel grid. The voxels are grouped into
+/// blocks of BLOCK_SIZE^3 and only blocks within the splat radius of a
+/// particle are visited. Every cell of the neighbour grid is a run of
+/// spatially close particles in the sorted order; the runs are binned to
+/// the blocks they touch, then the workers take one block at a time,
+/// splat the density of the block's runs onto its voxel corners and
+/// march its cubes into per-thread triangle lists, which are finally
+/// concatenated.
+///
+/// All tables and scratch buffers persist across calls.
+class SurfaceExtractor
+{
+public:
+    static const int BLOCK_SIZE = 8;
+
+    /// Extracts the iso surface of the particles, which must still be in
+    /// the order grid was built for. The particles may have moved since,
+    /// the runs are bounded by their current positions. An empty grid
+    /// gives an empty mesh.
+    void extract(
+        ThreadPool &threadPool, const ParticleData &particles,
+        const NeighborGrid &grid, const SPHSettings &settings,
+        const SurfaceSettings &surface, SurfaceMesh &mesh);
+
+    /// Blocks visited by the last extract().
+    size_t getActiveBlockCount() const { return activeBlocks.size(); }
+    /// Voxels along every axis of the last extract().
+    const glm::ivec3 &getVoxelDims() const { return voxelDims; }
+
+private:
+    struct ThreadScratch
+    {
+        // gradient in xyz and value in w of every voxel corner of a block
+        std::vector<glm::vec4> field;
+        // vertex of every cut voxel edge of the current block
+        std::vector<uint32_t> edgeVertices;
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> normals;
+        std::vector<uint32_t> indices;
+    };
+
+    void binRuns(const glm::vec3 &origin, float blockWidth, float radius);
+    void extractBlock(
+        const ParticleData &particles, uint32_t slot, const glm::vec3 &origin,
+        float voxelSize, float radius, float isoLevel, ThreadScratch &scratch);
+
+    // current position bounds of every occupied cell's particles
+    std::vector<glm::vec3> runLower;
+    std::vector<glm::vec3> runUpper;
+    std::vector<uint32_t> runStarts;
+    std::vector<uint32_t> runEnds;
+
+    glm::ivec3 voxelDims{0};
+    glm::ivec3 blockDims{0};
+    // blockStamps[block] == stamp marks the blocks of the current call,
+    // so the tables never need clearing
+    std::vector<uint32_t> blockStamps;
+    std::vector<uint32_t> blockSlots;
+    uint32_t stamp{0};
+    // active blocks and the runs binned to each, as offsets into blockRuns
+    std::vector<uint32_t> activeBlocks;
+    std::vector<uint32_t> blockRunOffsets;
+    std::vector<uint32_t> blockRuns;
+
+    std::vector<ThreadScratch> scratch;
+    std::vector<size_t> vertexOffsets;
+    std::vector<size_t> indexOffsets;
+};
+
+#endif // SPH_SURFACE_EXTRACTOR_H
@@ -71,7 +71,20 @@ void Texture::SetTextureFormat(int width, int height, uint32_t format,uint32_t t
   m_format = format;
   m_type=type;
 
-  glTexImage2D(GL_TEXTURE_2D, 0, m_format,
+  // float color targets need a sized internal format, an unsized one
+  // would let the driver store 8 bits per channel
+  uint32_t internalFormat = m_format;
+  if (m_type == GL_FLOAT) {
+    switch (m_format) {
+    case GL_RED: internalFormat = GL_R32F; break;
+    case GL_RG: internalFormat = GL_RG32F; break;
+    case GL_RGB: internalFormat = GL_RGB32F; break;
+    case GL_RGBA: internalFormat = GL_RGBA32F; break;
+    default: break;
+    }
+  }
+
+  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat,
     m_width, m_height, 0,
     m_format, m_type,
     nullptr);
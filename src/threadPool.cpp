@@ -0,0 +1,229 @@
+#include <algorithm>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "threadPool.h"
+#include "profiler.h"
+
+namespace {
+// Polls before a waiting thread falls back to its condition variable, so
+// back-to-back phases of one step are picked up without sleeping.
+const int SPIN_COUNT = 4096;
+}
+
+ThreadPool::ThreadPool(size_t threadCount)
+    : threadCount(threadCount > 0 ? threadCount : 1),
+    finishTimes(this->threadCount),
+    idleTimes(this->threadCount, 0.0),
+    taskQueues(this->threadCount)
+{
+    workers.reserve(this->threadCount - 1);
+    for (size_t i = 1; i < this->threadCount; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        publishedGeneration.store(++generation, std::memory_order_release);
+    }
+    wakeCondition.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::run(const Job &job)
+{
+    if (workers.empty()) {
+        job(0, 1);
+        return;
+    }
+
+    currentJob = &job;
+    pending.store(workers.size(), std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        publishedGeneration.store(++generation, std::memory_order_release);
+    }
+    wakeCondition.notify_all();
+
+    job(0, threadCount);
+    finishTimes[0] = Clock::now();
+
+    // Phase barrier: wait for the remaining workers
+    bool done = false;
+    for (int spin = 0; spin < SPIN_COUNT && !done; spin++) {
+        done = pending.load(std::memory_order_acquire) == 0;
+        if (!done) {
+            std::this_thread::yield();
+        }
+    }
+    if (!done) {
+        std::unique_lock<std::mutex> lock(mutex);
+        doneCondition.wait(lock, [this] {
+            return pending.load(std::memory_order_acquire) == 0;
+        });
+    }
+
+    // Every worker idled from its own end to the last one's
+    Clock::time_point phaseEnd = finishTimes[0];
+    for (size_t t = 1; t < threadCount; t++) {
+        phaseEnd = std::max(phaseEnd, finishTimes[t]);
+    }
+    for (size_t t = 0; t < threadCount; t++) {
+        idleTimes[t] += std::chrono::duration<double>(phaseEnd - finishTimes[t]).count();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const RangeJob &job)
+{
+    run([&](size_t threadIndex, size_t threadCount) {
+        size_t start, end;
+        blockRange(count, threadIndex, threadCount, start, end);
+        if (start < end) {
+            job(start, end);
+        }
+    });
+}
+
+void ThreadPool::blockRange(
+    size_t count, size_t threadIndex, size_t threadCount,
+    size_t &start, size_t &end)
+{
+    size_t blockSize = count / threadCount;
+    start = threadIndex * blockSize;
+    end = threadIndex + 1 == threadCount ? count : start + blockSize;
+}
+
+void ThreadPool::runTasks(size_t taskCount, const TaskJob &job)
+{
+    for (size_t t = 0; t < threadCount; t++) {
+        size_t start, end;
+        blockRange(taskCount, t, threadCount, start, end);
+        taskQueues[t].range.store(
+            uint64_t(start) << 32 | uint64_t(end), std::memory_order_relaxed);
+    }
+    // run() publishes the queues to the workers
+    run([&](size_t threadIndex, size_t threadCount) {
+        size_t task;
+        while (popTask(threadIndex, task)) {
+            job(task, threadIndex);
+        }
+        // No task is ever added, so one round over the others suffices
+        for (size_t k = 1; k < threadCount; k++) {
+            size_t victim = (threadIndex + k) % threadCount;
+            while (stealTask(victim, task)) {
+                job(task, threadIndex);
+            }
+        }
+    });
+}
+
+bool ThreadPool::popTask(size_t threadIndex, size_t &task)
+{
+    std::atomic<uint64_t> &range = taskQueues[threadIndex].range;
+    uint64_t current = range.load(std::memory_order_relaxed);
+    while (true) {
+        uint64_t front = current >> 32;
+        uint64_t back = current & 0xffffffffu;
+        if (front >= back) {
+            return false;
+        }
+        if (range.compare_exchange_weak(current, (front + 1) << 32 | back,
+                std::memory_order_relaxed)) {
+            task = size_t(front);
+            return true;
+        }
+    }
+}
+
+bool ThreadPool::stealTask(size_t victim, size_t &task)
+{
+    std::atomic<uint64_t> &range = taskQueues[victim].range;
+    uint64_t current = range.load(std::memory_order_relaxed);
+    while (true) {
+        uint64_t front = current >> 32;
+        uint64_t back = current & 0xffffffffu;
+        if (front >= back) {
+            return false;
+        }
+        if (range.compare_exchange_weak(current, front << 32 | (back - 1),
+                std::memory_order_relaxed)) {
+            task = size_t(back - 1);
+            return true;
+        }
+    }
+}
+
+bool ThreadPool::setAffinity(const std::vector<int> &cpus, bool pin)
+{
+#ifdef __linux__
+    if (cpus.empty()) {
+        return false;
+    }
+    std::atomic<bool> applied{true};
+    // Every worker sets its own affinity
+    run([&](size_t threadIndex, size_t) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (pin) {
+            CPU_SET(cpus[threadIndex % cpus.size()], &set);
+        }
+        else {
+            for (int cpu : cpus) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            applied = false;
+        }
+    });
+    return applied;
+#else
+    (void)cpus;
+    (void)pin;
+    return false;
+#endif
+}
+
+void ThreadPool::resetIdleTimes()
+{
+    std::fill(idleTimes.begin(), idleTimes.end(), 0.0);
+}
+
+void ThreadPool::workerLoop(size_t threadIndex)
+{
+    uint64_t seen = 0;
+    while (true) {
+        uint64_t current = publishedGeneration.load(std::memory_order_acquire);
+        for (int spin = 0; current == seen && spin < SPIN_COUNT; spin++) {
+            std::this_thread::yield();
+            current = publishedGeneration.load(std::memory_order_acquire);
+        }
+        if (current == seen) {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeCondition.wait(lock, [&] { return generation != seen; });
+            current = generation;
+        }
+        seen = current;
+
+        if (stopping) {
+            return;
+        }
+        {
+            SPH_PROFILE_ZONE("worker job");
+            (*currentJob)(threadIndex, threadCount);
+        }
+        finishTimes[threadIndex] = Clock::now();
+
+        if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(mutex);
+            doneCondition.notify_one();
+        }
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef SPH_THREAD_POOL_H
+#define SPH_THREAD_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// \class ThreadPool
+///
+/// Long-lived worker threads for the CPU solver. run() hands one job to
+/// every worker and returns once all of them reached the end of the phase,
+/// so a step never creates or joins threads. The calling thread takes part
+/// as worker 0.
+///
+/// Every worker's wait at the end of a phase, from finishing its part to
+/// the end of the slowest one, adds up as its idle time.
+class ThreadPool
+{
+public:
+    using Job = std::function<void(size_t threadIndex, size_t threadCount)>;
+    using RangeJob = std::function<void(size_t start, size_t end)>;
+    using TaskJob = std::function<void(size_t task, size_t threadIndex)>;
+
+    explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t size() const { return threadCount; }
+
+    /// Runs job on every worker and blocks until all of them finished.
+    void run(const Job &job);
+
+    /// Splits [0, count) into size() contiguous blocks, one per worker.
+    void parallelFor(size_t count, const RangeJob &job);
+
+    /// The block [start, end) of [0, count) that parallelFor gives to the
+    /// worker threadIndex, for jobs that need the same split across phases.
+    static void blockRange(
+        size_t count, size_t threadIndex, size_t threadCount,
+        size_t &start, size_t &end);
+
+    /// Runs job once for every task of [0, taskCount) and blocks until all
+    /// finished. Every worker starts on its own contiguous block of tasks,
+    /// front to back; a worker whose block ran out steals the last task of
+    /// another one's, so uneven tasks don't leave it waiting.
+    void runTasks(size_t taskCount, const TaskJob &job);
+
+    /// With pin, binds worker t to cpus[t % cpus.size()], else lets every
+    /// worker run on all of cpus. Worker 0 is the calling thread. Returns
+    /// false where thread affinity is unsupported or was refused.
+    bool setAffinity(const std::vector<int> &cpus, bool pin);
+
+    /// Seconds every worker idled since the last resetIdleTimes().
+    const std::vector<double> &getIdleTimes() const { return idleTimes; }
+    void resetIdleTimes();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Tasks [front, back) of one worker, packed as front << 32 | back, so
+    // the owner and the thieves take tasks with one compare-exchange
+    struct alignas(64) TaskQueue
+    {
+        std::atomic<uint64_t> range{0};
+    };
+
+    void workerLoop(size_t threadIndex);
+    bool popTask(size_t threadIndex, size_t &task);
+    bool stealTask(size_t victim, size_t &task);
+
+    size_t threadCount;
+    std::vector<std::thread> workers;
+
+    const Job *currentJob{nullptr};
+    uint64_t generation{0};
+    std::atomic<uint64_t> publishedGeneration{0};
+    std::atomic<size_t> pending{0};
+    bool stopping{false};
+
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable doneCondition;
+
+    // written by every worker when it finished the current job
+    std::vector<Clock::time_point> finishTimes;
+    std::vector<double> idleTimes;
+    std::vector<TaskQueue> taskQueues;
+};
+
+#endif // SPH_THREAD_POOL_H
@@ -0,0 +1,62 @@
+#ifndef SPH_TRIPLE_BUFFER_H
+#define SPH_TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+/// \class TripleBuffer
+///
+/// Lock-free handoff of the latest value from one writer thread to one
+/// reader thread. The writer fills its back buffer and publishes it, the
+/// reader takes the latest published buffer whenever it wants one; neither
+/// side ever waits for the other, and a buffer is never written while the
+/// reader holds it.
+///
+/// The three buffers rotate through the roles back (writer), middle (last
+/// published) and front (reader). The middle index is the only shared
+/// state and carries a flag that marks it as not yet taken by the reader.
+template <class T>
+class TripleBuffer
+{
+public:
+    /// Writer side: the buffer to fill next.
+    T &getBack() { return buffers[back]; }
+    /// Writer side: makes the back buffer the latest one.
+    void publish()
+    {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+    /// Writer side: whether the reader took the last published buffer, so
+    /// a new one would not just replace an unread one.
+    bool isTaken() const
+    {
+        return (middle.load(std::memory_order_relaxed) & FRESH) == 0;
+    }
+
+    /// Reader side: takes the latest published buffer if there is a newer
+    /// one than the current front. Returns whether the front changed.
+    bool update()
+    {
+        if ((middle.load(std::memory_order_relaxed) & FRESH) == 0) {
+            return false;
+        }
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+    /// Reader side: the buffer taken by the last update().
+    const T &getFront() const { return buffers[front]; }
+
+    /// All three buffers, e.g. to size them before the threads start.
+    T *getBuffers() { return buffers; }
+
+private:
+    static const uint8_t INDEX = 0x3;
+    static const uint8_t FRESH = 0x4;
+
+    T buffers[3];
+    uint8_t back{0};
+    std::atomic<uint8_t> middle{1};
+    uint8_t front{2};
+};
+
+#endif // SPH_TRIPLE_BUFFER_H